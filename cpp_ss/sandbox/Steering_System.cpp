@@ -1,5 +1,6 @@
 
 #include <algorithm>
+#include <filesystem>
 #include <iostream>
 #include <iterator>
 #include <math.h>
@@ -7,13 +8,19 @@
 
 #include "blocks.hpp"
 #include "helper.hpp"
+#include "mat_file.hpp"
+#include "model_file.hpp"
 #include "solver.hpp"
 #include "gp-ios.hpp"
 
-#include "front_wheel_angle_Rq.hpp"
-
 using namespace blocks;
 
+// the time constant, kept away from 0 and from the too slow
+Value clamp(double /*t*/, const Value& x)
+{
+    return x.max(0.001).min(10);
+}
+
 class PT : public Submodel
 {
 public:
@@ -83,11 +90,7 @@ public:
         {
             new MulDiv("*/", "**", {ad_DsrdFtWhlAngl_Rq_VD, "front_wheel_ang_gain"}, "007");
             new Delay("Delay", {"007", "front_wheel_ang_delay", "front_wheel_ang_init_value"}, {-2});
-            new Function("Clamp",
-                [](double /*t*/, const Value& x) -> Value
-                {
-                    return x.max(0.001).min(10);
-                }, "front_wheel_ang_t_const", "008");
+            new Function("Clamp", clamp, "front_wheel_ang_t_const", "008");
             new PT({-2, "008", -2}, front_wheel_angle);
             new Derivative("Derivative", front_wheel_angle, front_wheel_angle_rate);
             new Gain("K1", -1, front_wheel_angle, front_wheel_angle_neg);
@@ -106,28 +109,21 @@ public:
     }
 };
 
-double interp1d(double x, const std::vector<double>& X, const std::vector<double>& Y)
+int main(int argc, char* argv[])
 {
-    assert((X.size() == Y.size()) and (not X.empty()));
-
-    if (x <= X.front())
-        return Y.front();
-    if (x >= X.back())
-        return Y.back();
-    auto xlb_it = std::lower_bound(X.begin(), X.end(), x);
-    double x0 = *xlb_it;
-    double x1 = *(xlb_it + 1);
-    auto ylb_it = Y.begin() + std::distance(X.begin(), xlb_it);
-    double y0 = *ylb_it;
-    double y1 = *(ylb_it + 1);
-    return (y1 - y0)*(x - x0)/(x1 - x0) + y0;
-}
-
-int main()
-{
-    // front_wheel_angle_Rq = helper.load_mat_files_as_bus(
-    //     "/home/fathi/torc/git/playground/py_ss/data/processed_mat",
-    //     "front_wheel_angle_Rq")
+    // the recorded data, by default where it is in the repository, found from the program's
+    //   location (build/apps of the sandbox) rather than from the working directory
+    const std::string data_root = (argc > 1) ? argv[1] :
+        (std::filesystem::path(argv[0]).parent_path()/"../../../../py_ss/data/processed_mat").lexically_normal().string();
+    auto front_wheel_angle_Rq = load_mat_files_as_bus(data_root, "front_wheel_angle_Rq");
+    // the time grid is that of the request, which a file of a single row doesn't have
+    auto request = std::dynamic_pointer_cast<TabulatedInput>(front_wheel_angle_Rq->field("front_wheel_angle_Rq"));
+    if (not request)
+    {
+        std::cout << "-- no time series of front_wheel_angle_Rq in " << data_root << "\n";
+        return 1;
+    }
+    const auto& T = request->t();
 
     NodeValues parameters = {
         {"tractor_wheelbase", 5.8325},
@@ -138,62 +134,59 @@ int main()
         {"front_wheel_ang_init_value", 0.0},
         };
 
-    auto steering_system = SteeringSystem(
-        "front_wheel_angle_Rq",
-        "steering_info");
-    auto history = run(steering_system,
-        [](uint k, double& t) -> bool
+    auto time_cb = [&T](uint k, double& t) -> bool
+        {
+            return arange(k, t, T[0], T[T.size() - 1], 0.1);
+        };
+
+    // the model goes before the one of the model file is built, which names the same nodes
+    History history;
+    {
+        auto steering_system = SteeringSystem(
+            "front_wheel_angle_Rq",
+            "steering_info");
+        history = run(steering_system, time_cb,
+            InputSources{{"front_wheel_angle_Rq", front_wheel_angle_Rq}},
+            parameters, rk4);
+    }
+
+    // the same model, described by Steering_System.ssm (next to this file, or the second argument)
+    const std::string model_path = (argc > 2) ? argv[2] :
+        (std::filesystem::path(argv[0]).parent_path()/"../../Steering_System.ssm").lexically_normal().string();
+    BlockFactory::add_function("clamp", clamp);
+    {
+        auto spec = load_model_spec(model_path);
+        auto steering_system = build_model(spec);
+        auto file_history = run(*steering_system, time_cb,
+            InputSources{{"front_wheel_angle_Rq", front_wheel_angle_Rq}},
+            spec.parameters, rk4);
+        double difference = 0;
+        for (const auto& [node, values]: history)
         {
-            return arange(k, t, FRONT_WHEEL_ANGLE_RQ_X.front(),
-                FRONT_WHEEL_ANGLE_RQ_X.back(), 0.1);
-        },
-        [](double t, const NodeValues& /*x*/, NodeValues& inputs) -> void
+            auto it = file_history.find(node);
+            if ((it == file_history.end()) or (it->second.rows() != values.rows()) or (it->second.cols() != values.cols()))
+            {
+                std::cout << "-- " << model_path << " doesn't record " << node << " as the hand-built model does\n";
+                return 1;
+            }
+            difference = std::max(difference, (it->second - values).cwiseAbs().maxCoeff());
+        }
+        std::cout << model_path << ": largest difference from the hand-built model: " << difference << "\n";
+    }
+
+    // the recorded outputs, against which the simulated ones are compared
+    auto steering_info = load_mat_files_as_bus(data_root, "steering_info");
+    const auto& t = history.at("t");
+    for (const auto& [field, source]: steering_info->fields())
+    {
+        const auto& simulated = history.at(field);
+        Value recorded;
+        double difference = 0;
+        for (Eigen::Index k = 0; k < t.rows(); k++)
         {
-            inputs.insert_or_assign("front_wheel_angle_Rq",
-                interp1d(t, FRONT_WHEEL_ANGLE_RQ_X, FRONT_WHEEL_ANGLE_RQ_Y));
-        },
-        parameters, rk4);
-
-    // steering_info = helper.load_mat_files_as_bus(
-    //     "/home/fathi/torc/git/playground/py_ss/data/processed_mat",
-    //     "steering_info")
-
-    // print(history.keys())
-
-    // T = history["t"]
-
-    // for f, mat in steering_info.items():
-    //     print(f)
-    //     if callable(mat):
-    //         mat = mat.y
-    //     mat = mat[slc]
-        
-    //     blk = history["Steering_System." + f]
-        
-    //     plt.figure()
-        
-    //     if blk.ndim == 2:
-    //         n = blk.shape[1]
-    //         for k in range(n):
-    //             plt.subplot(n, 1, k+1)
-    //             if k == 0:
-    //                 plt.title(f)
-    //             blk_k = blk[:, k]
-    //             if mat.ndim == 2:
-    //                 mat_k = mat[:, k]
-    //                 plt.plot(T, mat_k, "rx")
-    //             else:
-    //                 mat_k = mat[k]
-    //                 plt.plot(T[0], mat_k, "rx")
-    //             plt.plot(T, blk_k, "b-")
-    //             plt.plot(T, blk_k - mat_k, "g-")
-    //             plt.grid()
-    //     else:
-    //         plt.title(f)
-    //         plt.plot(T, mat, "rx")
-    //         plt.plot(T, blk, "b-")
-    //         plt.plot(T, blk - mat, "g-")
-    //         plt.grid()
-
-    // plt.show()
+            source->value(t(k, 0), recorded);
+            difference = std::max(difference, (simulated.row(k).transpose().array() - recorded).abs().maxCoeff());
+        }
+        std::cout << field << ": largest difference from the recorded values: " << difference << "\n";
+    }
 }
@@ -1,7 +1,9 @@
 
 #include <iostream>
 #include <algorithm>
-#include <experimental/random>
+#include <cmath>
+#include <cstddef>
+#include <limits>
 
 #include "blocks.hpp"
 
@@ -42,16 +44,16 @@ Base::Base(const char* name, const Nodes& iports, const Nodes& oports, bool regi
     {
         for (auto& port: _oports)
         {
-            if (std::find(_all_oports.cbegin(), _all_oports.cend(), port) != _all_oports.cend())
-                std::cout << *std::find(_all_oports.cbegin(), _all_oports.cend(), port) << "\n";
-            assert(std::find(_all_oports.cbegin(), _all_oports.cend(), port) == _all_oports.cend());
-            _all_oports.push_back(port);
+            bool unique = _all_oports.insert(port).second;
+            if (not unique)
+                std::cout << port << "\n";
+            assert(unique);
         }
+        _registration.owned = true;
     }
 
     for (auto& port: _iports)
-        if (std::find(_all_iports.cbegin(), _all_iports.cend(), port) == _all_iports.cend())
-            _all_iports.push_back(port);
+        _all_iports.insert(port);
 }
 
 uint Base::_process(double t, NodeValues& x, bool reset)
@@ -86,8 +88,70 @@ uint Base::_process(double t, NodeValues& x, bool reset)
     return 1;
 }
 
-Nodes Base::_all_iports;
-Nodes Base::_all_oports;
+std::unordered_set<std::string> Base::_all_iports;
+std::unordered_set<std::string> Base::_all_oports;
+
+Base::~Base()
+{
+    if (_registration.owned)
+        for (auto& port: _oports)
+            _all_oports.erase(port);
+}
+
+namespace
+{
+
+// precedes each block, arena is nullptr if the block is on the heap
+struct alignas(std::max_align_t) BlockHeader
+{
+    Arena* arena;
+};
+
+}
+
+void* Base::operator new(std::size_t size)
+{
+    auto* arena = Submodel::arena();
+    size += sizeof(BlockHeader);
+    auto* header = static_cast<BlockHeader*>(arena ? arena->allocate(size) : ::operator new(size));
+    header->arena = arena;
+    return header + 1;
+}
+
+void Base::operator delete(void* p)
+{
+    if (not p)
+        return;
+
+    auto* header = static_cast<BlockHeader*>(p) - 1;
+    if (not header->arena)
+        ::operator delete(header);
+}
+
+void* Arena::allocate(std::size_t size)
+{
+    constexpr auto ALIGN = alignof(std::max_align_t);
+    size = (size + ALIGN - 1)/ALIGN*ALIGN;
+
+    if (size > _left)
+    {
+        // a large block gets a chunk of its own, the current chunk is still used afterwards
+        if (size > CHUNK_SIZE/4)
+        {
+            _chunks.emplace_back(new char[size]);
+            return _chunks.back().get();
+        }
+
+        _chunks.emplace_back(new char[CHUNK_SIZE]);
+        _next = _chunks.back().get();
+        _left = CHUNK_SIZE;
+    }
+
+    auto* p = _next;
+    _next += size;
+    _left -= size;
+    return p;
+}
 
 uint Integrator::_process(double /*t*/, NodeValues& x, bool reset)
 {
@@ -114,7 +178,120 @@ uint Memory::_process(double /*t*/, NodeValues& x, bool reset)
     return 1;
 }
 
+Tangents Function::tangents(double t, const NodeValues& x, const Tangents& dx)
+{
+    const auto& x0 = x.second[0];
+    const auto& d = dx[0];
+    Tangent ret;
+    for (Eigen::Index k = 0; k < d.cols(); k++)
+    {
+        const double norm = d.col(k).abs().maxCoeff();
+        if (norm == 0)
+            continue;
+        const double h = std::cbrt(std::numeric_limits<double>::epsilon())*std::max(1.0, x0.abs().maxCoeff())/norm;
+        Value xp(x0 + h*d.col(k));
+        Value xm(x0 - h*d.col(k));
+        Value col((_act_func(t, xp) - _act_func(t, xm))/(2*h));
+        if (ret.size() == 0)
+            ret = Tangent::Zero(col.size(), d.cols());
+        ret.col(k) = col;
+    }
+    return {ret};
+}
+
+Tangents Delay::tangents(double t, const NodeValues& x, const Tangents& dx)
+{
+    // the same cases as activation_function()
+    auto stored = [&](std::size_t k) -> Tangent
+    {
+        return ((k < _dx.size()) and (_dx[k].size() > 0)) ? _dx[k] : Tangent::Zero(1, dx[0].cols());
+    };
+
+    if (_t.empty())
+        return {dx[2].topRows(1)};
+
+    const double delay = x.second[1][0];
+    const double now = t;
+    t -= delay;
+    if (t <= _t.front())
+        return {dx[2]};
+    else if (t >= _t.back())
+    {
+        const auto last = _t.size() - 1;
+        if (now <= _t.back())
+            return {stored(last)};
+        const double w = (t - _t.back())/(now - _t.back());
+        const double slope = (x.second[0][0] - _x.back()[0])/(now - _t.back());
+        return {(dx[0].topRows(1) - stored(last))*w + stored(last) - slope*dx[1].topRows(1)};
+    }
+
+    std::size_t k = 0;
+    for (const auto& v: _t)
+    {
+        if (v >= t)
+            break;
+        k++;
+    }
+
+    const double w = (t - _t[k - 1])/(_t[k] - _t[k - 1]);
+    const double slope = (_x[k][0] - _x[k - 1][0])/(_t[k] - _t[k - 1]);
+    return {(stored(k) - stored(k - 1))*w + stored(k - 1) - slope*dx[1].topRows(1)};
+}
+
+void Delay::step_tangents(double /*t*/, const NodeValues& states, const Tangents& tangents)
+{
+    // step() has either replaced the last sample or appended one
+    const auto& d = tangents[std::distance(states.first.cbegin(), states.find(_iports.front()))];
+    _dx.resize(_t.size(), Tangent::Zero(d.rows(), d.cols()));
+    _dx.back() = d;
+}
+
 std::vector<Submodel*> Submodel::_current_submodels;
+thread_local Arena* Submodel::_cloning_arena{nullptr};
+std::unordered_set<int> Submodel::_models;
+
+Arena* Submodel::arena()
+{
+    if (_cloning_arena)
+        return _cloning_arena;
+    return _current_submodels.empty() ? nullptr : &_current_submodels.front()->_arena;
+}
+
+Submodel::Submodel(const char* name, const Nodes& iports, const Nodes& oports) :
+    Base(name, iports, oports, false)
+{
+    // an outermost submodel takes the lowest number no live model has
+    if (current() == nullptr)
+    {
+        _model = 0;
+        while (_models.count(_model))
+            _model++;
+        _models.insert(_model);
+    }
+}
+
+Submodel::Submodel(const Submodel& other) :
+    Base(other), _auto_node_name(other._auto_node_name), _n_auto_nodes(other._n_auto_nodes)
+{
+    // the components of a cloned model go to the arena of its outermost clone
+    auto* cloning_arena = _cloning_arena;
+    if (not cloning_arena)
+        _cloning_arena = &_arena;
+
+    _components.reserve(other._components.size());
+    for (const auto* component: other._components)
+        _components.push_back(component->clone());
+
+    _cloning_arena = cloning_arena;
+}
+
+Submodel::~Submodel()
+{
+    if (_model >= 0)
+        _models.erase(_model);
+    for (auto* component: _components)
+        delete component;
+}
 
 Node Submodel::get_node_name(const Node& node, bool makenew)
 {
@@ -133,12 +310,13 @@ Node Submodel::get_node_name(const Node& node, bool makenew)
     {
         if (makenew)
         {
-            constexpr auto N = 10;
-            char name[N + 2] = "-";
-            for (auto i = 1; i <= N; i++)
-                name[i] = char(std::experimental::randint(int('a'), int('z')));
-            name[N + 1] = 0;
-            ret = name;
+            // numbered within the model by its outermost submodel, and by the number of the model
+            //   if others are alive, e.g. "-PT.~3" in the first and "-PT.~1.3" in the second. so
+            //   a model gets the same names every time a program builds its models in the same
+            //   order, but never those of another live model, or of a sibling with the same name.
+            auto* root = _current_submodels.front();
+            ret = "-~" + ((root->_model > 0) ? std::to_string(root->_model) + "." : std::string())
+                + std::to_string(++root->_n_auto_nodes);
             auto_gen = true;
         }
         else
@@ -183,7 +361,7 @@ uint Submodel::_process(double t, NodeValues& x, bool reset)
     return n_processed;
 }
 
-bool Submodel::traverse(TraverseCallback cb)
+bool Submodel::traverse(TraverseCallback cb) const
 {
     for (auto& component: _components)
     {
@@ -7,11 +7,21 @@
 #include <iterator>
 #include <string>
 #include <map>
+#include <memory>
+#include <unordered_set>
 #include <vector>
 #include <cassert>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <type_traits>
+#include <utility>
 
 #include "../3rdparty/eigen/Eigen/Core"
 
+#include "serialize.hpp"
+
 using namespace Eigen;
 
 namespace blocks
@@ -67,6 +77,12 @@ using Scalars          = std::vector<double>;
 using Values           = std::vector<Value>;
 using TraverseCallback = std::function<bool(const Base&)>;
 using ActFunction      = std::function<Value(double, const Value&)>;
+using ZCFunction       = std::function<Scalars(double, const Value&)>;
+
+// forward-mode derivatives of a value with respect to some directions (e.g. parameters): one row
+//   per element of the value, one column per direction
+using Tangent          = ArrayXXd;
+using Tangents         = std::vector<Tangent>;
 
 std::ostream& operator<<(std::ostream&, const class NodeValues&);
 
@@ -183,30 +199,154 @@ inline std::ostream& operator<<(std::ostream& os, const NodeValues& nv)
     return os << "\n";
 }
 
+// when a block is evaluated: at every solver stage (continuous), only at t = offset + k*period and
+//   held in between (discrete), once per parameter change (constant) or as its inputs (inherited)
+class SampleTime
+{
+public:
+    enum class Type {continuous, discrete, inherited, constant};
+
+protected:
+    Type   _type;
+    double _period;
+    double _offset;
+
+public:
+    SampleTime(Type type=Type::inherited, double period=0.0, double offset=0.0) :
+        _type(type), _period(period), _offset(offset) {}
+
+    static SampleTime continuous() {return SampleTime(Type::continuous);}
+    static SampleTime discrete(double period, double offset=0.0) {return SampleTime(Type::discrete, period, offset);}
+    static SampleTime inherited() {return SampleTime(Type::inherited);}
+    static SampleTime constant() {return SampleTime(Type::constant);}
+
+    Type type() const {return _type;}
+    double period() const {return _period;}
+    double offset() const {return _offset;}
+
+    bool operator==(const SampleTime& rhs) const
+    {
+        return (_type == rhs._type) and (_period == rhs._period) and (_offset == rhs._offset);
+    }
+    bool operator!=(const SampleTime& rhs) const {return not (*this == rhs);}
+};
+
+// a monotonic buffer the blocks of a model are allocated from, contiguously and in construction
+//   order. deleting a block only destructs it, the memory is released at once with the arena.
+class Arena
+{
+protected:
+    static constexpr std::size_t CHUNK_SIZE = 64*1024;
+
+    std::vector<std::unique_ptr<char[]>> _chunks;
+    char*       _next{nullptr};
+    std::size_t _left{0};
+
+public:
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(std::size_t size);
+    std::size_t n_chunks() const {return _chunks.size();}
+};
+
 class Base
 {
 protected:
-    static Nodes _all_iports;
-    static Nodes _all_oports;
+    static std::unordered_set<std::string> _all_iports;
+    static std::unordered_set<std::string> _all_oports;
+
+    // set for the block that registered its oports, whose destruction frees the names. copies
+    //   don't own the registration.
+    struct Registration
+    {
+        bool owned{false};
+
+        Registration() = default;
+        Registration(const Registration&) {}
+        Registration& operator=(const Registration&) {return *this;}
+    };
 
     Nodes _iports;
     Nodes _oports;
     NodeValues _known_values;
+    Registration _registration;
 
     std::string _name;
     bool _processed{false};
+    SampleTime _sample_time;
 
 public:
     Base(const char* name, const Nodes& iports=Nodes(), const Nodes& oports=Nodes(), bool register_oports=true);
+    virtual ~Base();
+
+    // blocks built inside a submodel are allocated from the arena of the outermost one, the
+    //   others from the heap
+    static void* operator new(std::size_t size);
+    static void operator delete(void* p);
+
+    // a deep copy that shares no mutable state with this block, e.g. to branch a simulation.
+    //   the copy keeps the node names and is not registered in any submodel.
+    virtual Base* clone() const
+    {
+        assert(false);
+        return nullptr;
+    }
+
+    // a Submodel's sample time is inherited by its components whose sample time is inherited
+    Base& set_sample_time(const SampleTime& sample_time)
+    {
+        _sample_time = sample_time;
+        return *this;
+    }
+    const SampleTime& sample_time() const {return _sample_time;}
 
     virtual void get_states(States& /*states*/) {}
+    // the values of the states, as solved, without stepping the other blocks
+    virtual void set_states(const NodeValues& /*states*/) {}
     virtual void step(double /*t*/, const NodeValues& /*states*/) {}
+
+    // the internal state of stateful blocks, for checkpoints
+    virtual void save_state(std::ostream& /*os*/) const {}
+    virtual void load_state(std::istream& /*is*/) {}
     virtual NodeValues activation_function(double /*t*/, const NodeValues& /*x*/)
     {
         assert(false);
         return NodeValues();
     }
 
+    // like activation_function(), but reading the inputs and writing the outputs where they are
+    //   kept, which still hold the previous outputs. false if the block doesn't support it.
+    virtual bool activate_in_place(double /*t*/, const std::vector<const Value*>& /*x*/, const std::vector<Value*>& /*y*/)
+    {
+        return false;
+    }
+
+    // forward-mode differentiation: the tangents of the outputs given those of the inputs (dx),
+    //   at the point (t, x) of the last activation_function() call. an empty tangent is zero.
+    virtual Tangents tangents(double /*t*/, const NodeValues& /*x*/, const Tangents& /*dx*/)
+    {
+        assert(false);
+        return Tangents();
+    }
+
+    // like step(), for the blocks that keep the tangents of past values. tangents is aligned with
+    //   states.first.
+    virtual void step_tangents(double /*t*/, const NodeValues& /*states*/, const Tangents& /*tangents*/) {}
+
+    // false if the outputs can be computed without knowing the current inputs (e.g. Memory)
+    virtual bool has_direct_feedthrough() const {return true;}
+
+    // true if the outputs only depend on the inputs (no time, no internal state), which allows
+    //   the block to be evaluated once when all of its inputs are constants or parameters
+    virtual bool is_pure() const {return false;}
+
+    // functions of the inputs whose sign changes mark discontinuities the solver should not
+    //   step over, e.g. the switching points of a saturation
+    virtual bool has_zero_crossings() const {return false;}
+    virtual Scalars zero_crossings(double /*t*/, const NodeValues& /*x*/) {return Scalars();}
+
     bool is_processed() const {return _processed;}
     const std::string& name() const {return _name;}
     const Nodes& iports() const {return _iports;}
@@ -217,7 +357,7 @@ public:
     // def __repr__(self):
     //     return str(type(self)) + ":" + self._name + ", iports:" + str(self._iports) + ", oports:" + str(self._oports)
 
-    virtual bool traverse(TraverseCallback cb)
+    virtual bool traverse(TraverseCallback cb) const
     {
         return cb(*this);
     }
@@ -254,54 +394,97 @@ public:
             _raw_names.push_back(p);
     }
 
+    Base* clone() const override {return new Bus(*this);}
+
+    bool is_pure() const override {return true;}
+
+    // the names of the fields, as given to the constructor
+    const std::vector<std::string>& fields() const {return _raw_names;}
+
+    // the fields are stacked in the order of _raw_names
     NodeValues activation_function(double /*t*/, const NodeValues& x) override
     {
         assert(x.first.size() == _raw_names.size());
-        NodeValues ret;
-        ret.first.reserve(_raw_names.size());
-        ret.second.reserve(_raw_names.size());
-        auto p = x.second.begin();
-        for (const auto& name: _raw_names)
+        Eigen::Index n = 0;
+        for (const auto& v: x.second)
+            n += v.size();
+        Value ret(n);
+        n = 0;
+        for (const auto& v: x.second)
         {
-            ret.insert_or_assign(name, *(p++));
+            ret.segment(n, v.size()) = v;
+            n += v.size();
         }
-        return ret;
+        return NodeValues(_oports, {ret});
+    }
+
+    Tangents tangents(double /*t*/, const NodeValues& /*x*/, const Tangents& dx) override
+    {
+        Eigen::Index n = 0;
+        for (const auto& d: dx)
+            n += d.rows();
+        Tangent ret(n, dx.front().cols());
+        n = 0;
+        for (const auto& d: dx)
+        {
+            ret.middleRows(n, d.rows()) = d;
+            n += d.rows();
+        }
+        return {ret};
     }
 };
 
-// class BusSelector(Base):
-//     def __init__(self, name, iport='-', signals=[], oports=[]):
-//         if not isinstance(oports, (list, tuple)):
-//             oports = [oports]
-//         if not isinstance(signals, (list, tuple)):
-//             signals = [signals]
-            
-//         if not signals:
-//             signals = oports
-//         elif not oports:
-//             oports = signals
-//         assert len(signals) == len(oports)
-
-//         super().__init__(name, iport, oports)
-//         self._signals = signals
-//         self._indices = None
+// extracts signals of a bus, by the names of the nodes its Bus was built from ("a.b" for field b
+//   of a bus in field a). the signals default to the oports' names and the oports to the signals.
+//   the Schedule resolves the signals when it is built and copies them out of the bus without
+//   activating the block.
+class BusSelector : public Base
+{
+protected:
+    std::vector<std::string> _signals;
 
-//     def activation_function(self, t, x):
-//         bus_values = x[0]
-//         if self._indices is None:
-//             self._indices = [bus_values._names.index(s)
-//                              for s in self._signals]
-//         return [bus_values[k] for k in self._indices]
+    static Nodes _signals_as_oports(const std::vector<std::string>& signals, const Nodes& oports)
+    {
+        if (not oports.empty())
+            return oports;
+        return Nodes(signals.cbegin(), signals.cend());
+    }
+
+public:
+    BusSelector(const char* name, const Node& iport, const std::vector<std::string>& signals, const Nodes& oports=Nodes()) :
+        Base(name, iport, _signals_as_oports(signals, oports)), _signals(signals)
+    {
+        if (_signals.empty())
+            _signals.assign(oports.cbegin(), oports.cend());
+        assert(_oports.size() == _signals.size());
+    }
+
+    Base* clone() const override {return new BusSelector(*this);}
+
+    bool is_pure() const override {return true;}
+
+    const std::vector<std::string>& signals() const {return _signals;}
+
+    NodeValues activation_function(double /*t*/, const NodeValues& /*x*/) override
+    {
+        std::cout << "-- a BusSelector is only evaluated by a Schedule: " << _name << "\n";
+        assert(false);
+        return NodeValues();
+    }
+};
 
 class InitialValue : public Base
 {
 protected:
-    Value _value;
+    Value   _value;
+    Tangent _tangent;
 
 public:
     InitialValue(const char* name, const Node& iport=Node(), const Node& oport=Node()) :
         Base(name, iport, oport) {}
 
+    Base* clone() const override {return new InitialValue(*this);}
+
     NodeValues activation_function(double /*t*/, const NodeValues& x) override
     {
         if (_value.size() == 0)
@@ -311,6 +494,17 @@ public:
         }
         return NodeValues(_oports, {_value});
     }
+
+    // latched along with the value
+    Tangents tangents(double /*t*/, const NodeValues& /*x*/, const Tangents& dx) override
+    {
+        if (_iports.empty() and (_tangent.size() == 0))
+            _tangent = dx[0];
+        return {_tangent};
+    }
+
+    void save_state(std::ostream& os) const override {write_binary(os, _value);}
+    void load_state(std::istream& is) override {read_binary(is, _value);}
 };
 
 class Const : public Base
@@ -328,6 +522,10 @@ public:
          _value << value;
     }
 
+    Base* clone() const override {return new Const(*this);}
+
+    bool is_pure() const override {return true;}
+
     NodeValues activation_function(double /*t*/, const NodeValues& /*x*/) override
     {
         return NodeValues(_oports, {_value});
@@ -343,10 +541,19 @@ public:
     Gain(const char* name, double k, const Nodes& iport=Nodes({Node()}), const Nodes& oport=Nodes({Node()})) :
         Base(name, iport, oport), _k(k) {}
 
+    Base* clone() const override {return new Gain(*this);}
+
+    bool is_pure() const override {return true;}
+
     NodeValues activation_function(double /*t*/, const NodeValues& x) override
     {
         return NodeValues(_oports, {_k * x.second[0]});
     }
+
+    Tangents tangents(double /*t*/, const NodeValues& /*x*/, const Tangents& dx) override
+    {
+        return {_k * dx[0]};
+    }
 };
 
 class Sin : public Base
@@ -355,34 +562,181 @@ public:
     Sin(const char* name, const Nodes& iports=Nodes({Node()}), const Nodes& oports=Nodes({Node()})) :
         Base(name, iports, oports) {}
 
+    Base* clone() const override {return new Sin(*this);}
+
+    bool is_pure() const override {return true;}
+
     NodeValues activation_function(double /*t*/, const NodeValues& x) override
     {
         return NodeValues(_oports, {x.second[0].sin()});
     }
+
+    Tangents tangents(double /*t*/, const NodeValues& x, const Tangents& dx) override
+    {
+        return {dx[0].colwise() * x.second[0].cos()};
+    }
 };
 
 class Function : public Base
 {
 protected:
     ActFunction _act_func;
+    ZCFunction  _zc_func;
 
 public:
-    Function(const char* name, ActFunction act_func, const Node& iport=Node(), const Node& oport=Node()) :
-        Base(name, {iport}, {oport}), _act_func(act_func) {}
+    Function(const char* name, ActFunction act_func, const Node& iport=Node(), const Node& oport=Node(), ZCFunction zc_func=nullptr) :
+        Base(name, {iport}, {oport}), _act_func(act_func), _zc_func(zc_func) {}
+
+    Base* clone() const override {return new Function(*this);}
 
     NodeValues activation_function(double t, const NodeValues& x) override
     {
         return NodeValues(_oports, {_act_func(t, x.second[0])});
     }
+
+    // the act_func is a black box: central differences along each direction
+    Tangents tangents(double t, const NodeValues& x, const Tangents& dx) override;
+
+    bool has_zero_crossings() const override {return bool(_zc_func);}
+
+    Scalars zero_crossings(double t, const NodeValues& x) override
+    {
+        return _zc_func ? _zc_func(t, x.second[0]) : Scalars();
+    }
 };
 
-// class MIMOFunction(Base):
-//     def __init__(self, name, act_func, iports, oports):
-//         super().__init__(name, iports=iports, oports=oports)
-//         self._act_func = act_func
+// the inputs and outputs of a MIMOFunction's callable
+using InSpan  = Eigen::Ref<const ArrayXd>;
+using OutSpan = Eigen::Ref<ArrayXd>;
 
-//     def activation_function(self, t, x):
-//         return self._act_func(t, x)
+template<typename F>
+struct MIMOSignature : MIMOSignature<decltype(&F::operator())> {};
+
+template<typename... Args>
+struct MIMOSignature<void (*)(double, Args...)>
+{
+    static constexpr std::size_t n_in  = (std::size_t(std::is_same_v<Args, InSpan>) + ... + 0);
+    static constexpr std::size_t n_out = (std::size_t(std::is_same_v<Args, OutSpan>) + ... + 0);
+    static_assert(n_in + n_out == sizeof...(Args), "the arguments after t must be InSpan or OutSpan");
+};
+
+template<typename C, typename... Args>
+struct MIMOSignature<void (C::*)(double, Args...) const> : MIMOSignature<void (*)(double, Args...)> {};
+
+template<typename C, typename... Args>
+struct MIMOSignature<void (C::*)(double, Args...)> : MIMOSignature<void (*)(double, Args...)> {};
+
+// a block of user code with several inputs and outputs. func is called as func(t, inputs...,
+//   outputs...) with spans over the signals, so it allocates nothing and can be inlined, e.g.
+//
+//   new MIMOFunction("polar", [](double, InSpan x, InSpan y, OutSpan r, OutSpan theta)
+//       {
+//           r = (x*x + y*y).sqrt();
+//           theta = y.binaryExpr(x, [](double a, double b) {return std::atan2(a, b);});
+//       }, {"x", "y"}, {"r", "theta"});
+//
+// the outputs have the size of the first input unless output_sizes is given.
+template<typename F>
+class MIMOFunction : public Base
+{
+protected:
+    using Signature = MIMOSignature<F>;
+
+    F _func;
+    std::vector<Eigen::Index> _output_sizes;
+
+    template<std::size_t... I, std::size_t... O>
+    void _call(double t, const std::vector<const Value*>& x, const std::vector<Value*>& y,
+        std::index_sequence<I...>, std::index_sequence<O...>)
+    {
+        _func(t, InSpan(static_cast<const ArrayXd&>(*x[I]))..., OutSpan(static_cast<ArrayXd&>(*y[O]))...);
+    }
+
+    void _evaluate(double t, const std::vector<const Value*>& x, const std::vector<Value*>& y)
+    {
+        for (std::size_t k = 0; k < y.size(); k++)
+        {
+            auto size = _output_sizes.empty() ? (x.empty() ? 1 : x[0]->size()) : _output_sizes[k];
+            if (y[k]->size() != size)
+                y[k]->resize(size);
+        }
+        _call(t, x, y, std::make_index_sequence<Signature::n_in>(), std::make_index_sequence<Signature::n_out>());
+    }
+
+public:
+    MIMOFunction(const char* name, F func, const Nodes& iports, const Nodes& oports, std::vector<Eigen::Index> output_sizes={}) :
+        Base(name, iports, oports), _func(func), _output_sizes(std::move(output_sizes))
+    {
+        if ((iports.size() != Signature::n_in) or (oports.size() != Signature::n_out))
+        {
+            std::cout << "-- " << _name << ": the function takes " << Signature::n_in << " inputs and " <<
+                Signature::n_out << " outputs, " << iports.size() << " iports and " << oports.size() << " oports given\n";
+            assert(false);
+        }
+        assert(_output_sizes.empty() or (_output_sizes.size() == Signature::n_out));
+    }
+
+    Base* clone() const override {return new MIMOFunction(*this);}
+
+    bool activate_in_place(double t, const std::vector<const Value*>& x, const std::vector<Value*>& y) override
+    {
+        _evaluate(t, x, y);
+        return true;
+    }
+
+    NodeValues activation_function(double t, const NodeValues& x) override
+    {
+        std::vector<const Value*> in;
+        for (const auto& v: x.second)
+            in.push_back(&v);
+        NodeValues ret(_oports, Values(_oports.size()));
+        std::vector<Value*> out;
+        for (auto& v: ret.second)
+            out.push_back(&v);
+        _evaluate(t, in, out);
+        return ret;
+    }
+
+    // func is a black box: central differences along each direction, all the inputs at once
+    Tangents tangents(double t, const NodeValues& x, const Tangents& dx) override
+    {
+        Tangents ret(Signature::n_out);
+        const auto n_directions = std::accumulate(dx.cbegin(), dx.cend(), Eigen::Index(0),
+            [](Eigen::Index n, const Tangent& d) {return std::max(n, d.cols());});
+
+        NodeValues xp(x), xm(x);
+        for (Eigen::Index k = 0; k < n_directions; k++)
+        {
+            double norm = 0, scale = 1;
+            for (std::size_t n = 0; n < dx.size(); n++)
+            {
+                if (dx[n].size())
+                    norm = std::max(norm, dx[n].col(k).abs().maxCoeff());
+                scale = std::max(scale, x.second[n].abs().maxCoeff());
+            }
+            if (norm == 0)
+                continue;
+
+            const double h = std::cbrt(std::numeric_limits<double>::epsilon())*scale/norm;
+            for (std::size_t n = 0; n < dx.size(); n++)
+            {
+                if (dx[n].size() == 0)
+                    continue;
+                xp.second[n] = x.second[n] + h*dx[n].col(k);
+                xm.second[n] = x.second[n] - h*dx[n].col(k);
+            }
+            auto yp = activation_function(t, xp);
+            auto ym = activation_function(t, xm);
+            for (std::size_t n = 0; n < Signature::n_out; n++)
+            {
+                if (ret[n].size() == 0)
+                    ret[n] = Tangent::Zero(yp.second[n].size(), n_directions);
+                ret[n].col(k) = (yp.second[n] - ym.second[n])/(2*h);
+            }
+        }
+        return ret;
+    }
+};
 
 class AddSub : public Base
 {
@@ -397,6 +751,10 @@ public:
         assert(std::strlen(operators) == iports.size());
     }
 
+    Base* clone() const override {return new AddSub(*this);}
+
+    bool is_pure() const override {return true;}
+
     NodeValues activation_function(double /*t*/, const NodeValues& x) override
     {
         Value ret = Value::Constant(x.second[0].size(), _initial);
@@ -413,6 +771,21 @@ public:
         }
         return NodeValues(_oports, {ret});
     }
+
+    Tangents tangents(double /*t*/, const NodeValues& /*x*/, const Tangents& dx) override
+    {
+        Tangent ret = Tangent::Zero(dx[0].rows(), dx[0].cols());
+        const char* p = _operators.c_str();
+        for (const auto& d: dx)
+        {
+            if (*p == '+')
+                ret += d;
+            else
+                ret -= d;
+            p++;
+        }
+        return {ret};
+    }
 };
 
 class MulDiv : public Base
@@ -428,6 +801,10 @@ public:
         assert(std::strlen(operators) == iports.size());
     }
 
+    Base* clone() const override {return new MulDiv(*this);}
+
+    bool is_pure() const override {return true;}
+
     NodeValues activation_function(double /*t*/, const NodeValues& x) override
     {
         Value ret = Value::Constant(x.second[0].size(), _initial);
@@ -444,27 +821,65 @@ public:
         }
         return NodeValues(_oports, {ret});
     }
+
+    // the product and quotient rules, applied as the value is built up
+    Tangents tangents(double /*t*/, const NodeValues& x, const Tangents& dx) override
+    {
+        Value value = Value::Constant(x.second[0].size(), _initial);
+        Tangent ret = Tangent::Zero(dx[0].rows(), dx[0].cols());
+        const char* p = _operators.c_str();
+        auto d = dx.begin();
+        for (const auto& v: x.second)
+        {
+            if (*p == '*')
+            {
+                ret = ret.colwise() * v + d->colwise() * value;
+                value *= v;
+            }
+            else
+            {
+                ret = (ret - d->colwise() * (value / v)).colwise() / v;
+                value /= v;
+            }
+            p++;
+            d++;
+        }
+        return {ret};
+    }
 };
 
+// the state has the size of the initial condition, e.g. one element per wheel
 class Integrator : public Base
 {
 protected:
-    double _value;
+    Value _value;
 
 public:
-    Integrator(const char* name, const Node& iport=Node(), const Node& oport=Node(), double ic=0.0) :
+    Integrator(const char* name, const Node& iport=Node(), const Node& oport=Node(), const Value& ic=Value(0.0)) :
         Base(name, Nodes({iport}), Nodes({oport})), _value(ic) {}
 
+    Base* clone() const override {return new Integrator(*this);}
+
     void get_states(States& states) override
     {
         states.insert_or_assign(_oports.front(), _value, _iports.front());
     }
 
+    void set_states(const NodeValues& states) override
+    {
+        _value = states.at(_oports.front());
+    }
+
     void step(double /*t*/, const NodeValues& states) override
     {
-        _value = states.at(_oports.front())[0];
+        _value = states.at(_oports.front());
     }
 
+    bool has_direct_feedthrough() const override {return false;}
+
+    void save_state(std::ostream& os) const override {write_binary(os, _value);}
+    void load_state(std::istream& is) override {read_binary(is, _value);}
+
     uint _process(double t, NodeValues& x, bool reset) override;
 };
 
@@ -492,16 +907,26 @@ public:
 class Delay : public Base
 {
 protected:
-    double  _lifespan;
-    Scalars _t;
-    Values  _x;
+    double   _lifespan;
+    Scalars  _t;
+    Values   _x;
+    Tangents _dx;  // the tangents of _x, when differentiated
 
 public:
     Delay(const char* name, const Nodes& iports, const Nodes& oport=Nodes({Node()}), double lifespan=10.0) :
         Base(name, iports, oport), _lifespan(lifespan) {}
 
+    Base* clone() const override {return new Delay(*this);}
+
     void step(double t, const NodeValues& states) override
     {
+        // a run resumed from a checkpoint records its first point again
+        if ((not _t.empty()) and (t == _t.back()))
+        {
+            _x.back() = states.at(_iports.front());
+            return;
+        }
+
         if (not _t.empty())
         {
             double t1 = t - _lifespan;
@@ -514,6 +939,7 @@ public:
             }
             _t.erase(_t.begin(), _t.begin() + k);
             _x.erase(_x.begin(), _x.begin() + k);
+            _dx.erase(_dx.begin(), _dx.begin() + std::min<std::size_t>(k, _dx.size()));
         }
 
         assert(_t.empty() or (t > _t.back()));
@@ -521,12 +947,25 @@ public:
         _x.push_back(states.at(_iports.front()));
     }
 
+    void save_state(std::ostream& os) const override
+    {
+        write_binary(os, _t);
+        write_binary(os, _x);
+    }
+
+    void load_state(std::istream& is) override
+    {
+        read_binary(is, _t);
+        read_binary(is, _x);
+    }
+
     NodeValues activation_function(double t, const NodeValues& x) override
     {
         if (_t.empty())
             return NodeValues(_oports, {x.second[2][0]});
     
         const double delay = x.second[1][0];
+        const double now = t;
         t -= delay;
         if (t <= _t.front())
         {
@@ -534,7 +973,11 @@ public:
         }
         else if (t >= _t.back())
         {
-            return NodeValues(_oports, {_x.back()});
+            // past the last recorded sample, the current input is the next one. this makes the
+            //   output the same before and after step() records it.
+            if (now <= _t.back())
+                return NodeValues(_oports, {_x.back()});
+            return NodeValues(_oports, {(x.second[0][0] - _x.back()[0])*(t - _t.back())/(now - _t.back()) + _x.back()[0]});
         }
 
         int k = 0;
@@ -547,29 +990,55 @@ public:
 
         return NodeValues(_oports, {(_x[k][0] - _x[k - 1][0])*(t - _t[k - 1])/(_t[k] - _t[k - 1]) + _x[k - 1][0]});
     }
+
+    // also differentiates with respect to the delay: the output moves against the slope
+    Tangents tangents(double t, const NodeValues& x, const Tangents& dx) override;
+
+    void step_tangents(double t, const NodeValues& states, const Tangents& tangents) override;
 };
 
 class Memory : public Base
 {
 protected:
-    Value _value;
+    Value   _value;
+    Tangent _tangent;
 
 public:
     Memory(const char* name, const Node& iport=Node(), const Node& oport=Node(), const Value& ic=Value::Zero(1)) :
         Base(name, Nodes({iport}), Nodes({oport})), _value(ic) {}
 
+    Base* clone() const override {return new Memory(*this);}
+
     void step(double /*t*/, const NodeValues& states) override
     {
         _value = states.at(_iports.front());
     }
 
+    bool has_direct_feedthrough() const override {return false;}
+
+    void save_state(std::ostream& os) const override {write_binary(os, _value);}
+    void load_state(std::istream& is) override {read_binary(is, _value);}
+
     // # Memory can be implemented either by defining the following activation function
     // #   (which is more straightforward) or through overloading the _process method
     // #   which is more efficient since it deosn't rely on the input signal being known.
     // #   Both approaches are supposed to lead to the exact same results.
 
-    // # def activation_function(self, t, x):
-    // #     return [self._value]
+    // the compiled schedule uses the activation function
+    NodeValues activation_function(double /*t*/, const NodeValues& /*x*/) override
+    {
+        return NodeValues(_oports, {_value});
+    }
+
+    Tangents tangents(double /*t*/, const NodeValues& /*x*/, const Tangents& /*dx*/) override
+    {
+        return {_tangent};
+    }
+
+    void step_tangents(double /*t*/, const NodeValues& states, const Tangents& tangents) override
+    {
+        _tangent = tangents[std::distance(states.first.cbegin(), states.find(_iports.front()))];
+    }
 
     uint _process(double t, NodeValues& x, bool reset) override;
 };
@@ -581,11 +1050,15 @@ protected:
     double _t;
     Value  _x;
     Value  _y;
+    Tangent _dx;
+    Tangent _dy;
 
 public:
     Derivative(const char* name, const Node& iport=Node(), const Node& oport=Node(), const Value& y0=Value::Zero(1)) :
         Base(name, iport, oport), _y(y0) {}
 
+    Base* clone() const override {return new Derivative(*this);}
+
     void step(double t, const NodeValues& states) override
     {
         _t = t;
@@ -594,6 +1067,22 @@ public:
         _first_step = false;
     }
 
+    void save_state(std::ostream& os) const override
+    {
+        write_binary(os, _first_step);
+        write_binary(os, _t);
+        write_binary(os, _x);
+        write_binary(os, _y);
+    }
+
+    void load_state(std::istream& is) override
+    {
+        read_binary(is, _first_step);
+        read_binary(is, _t);
+        read_binary(is, _x);
+        read_binary(is, _y);
+    }
+
     NodeValues activation_function(double t, const NodeValues& x) override
     {
         if (_first_step)
@@ -607,15 +1096,36 @@ public:
 
         return NodeValues(_oports, {((x.second[0] - _x)/(t - _t))});
     }
+
+    Tangents tangents(double t, const NodeValues& /*x*/, const Tangents& dx) override
+    {
+        if (_first_step or (_t == t) or (_dx.size() == 0))
+            return {_dy};
+
+        return {(dx[0] - _dx)/(t - _t)};
+    }
+
+    void step_tangents(double /*t*/, const NodeValues& states, const Tangents& tangents) override
+    {
+        _dx = tangents[std::distance(states.first.cbegin(), states.find(_iports.front()))];
+        _dy = tangents[std::distance(states.first.cbegin(), states.find(_oports.front()))];
+    }
 };
 
 class Submodel : public Base
 {
 protected:
     static std::vector<Submodel*> _current_submodels;
+    static thread_local Arena* _cloning_arena;
+
+    // the numbers of the live models, see get_node_name()
+    static std::unordered_set<int> _models;
 
     std::vector<Base*> _components;
     std::string _auto_node_name;
+    uint _n_auto_nodes{0};  // only counted by the outermost submodel, for its whole model
+    int _model{-1};         // the number of the model of an outermost submodel
+    Arena _arena;  // only used by the outermost submodel, which outlives its components
 
 public:
     static Submodel* current()
@@ -623,8 +1133,18 @@ public:
         return Submodel::_current_submodels.empty() ? nullptr : Submodel::_current_submodels.back();
     }
 
-    Submodel(const char* name, const Nodes& iports=Nodes(), const Nodes& oports=Nodes()) :
-        Base(name, iports, oports, false) {}
+    // the arena new blocks are allocated from, if any
+    static Arena* arena();
+
+    Submodel(const char* name, const Nodes& iports=Nodes(), const Nodes& oports=Nodes());
+
+    // a submodel owns its components, so copying it clones them. subclasses only build their
+    //   components, hence a clone of one is a plain Submodel.
+    Submodel(const Submodel& other);
+    Submodel& operator=(const Submodel&) = delete;
+    ~Submodel() override;
+
+    Base* clone() const override {return new Submodel(*this);}
 
     void enter() {_current_submodels.push_back(this);}
     void exit()
@@ -638,12 +1158,20 @@ public:
         _components.push_back(&component);
     }
 
+    const std::vector<Base*>& components() const {return _components;}
+
     void get_states(States& states) override
     {
         for (auto* component: _components)
             component->get_states(states);
     }
 
+    void set_states(const NodeValues& states) override
+    {
+        for (auto* component: _components)
+            component->set_states(states);
+    }
+
     void step(double t, const NodeValues& states) override
     {
         for (auto& component: _components)
@@ -652,7 +1180,7 @@ public:
 
     Node get_node_name(const Node& node, bool makenew);
     uint _process(double t, NodeValues& x, bool reset) override;
-    bool traverse(TraverseCallback cb) override;
+    bool traverse(TraverseCallback cb) const override;
 
 }; // class Submodel
 
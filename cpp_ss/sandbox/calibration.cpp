@@ -0,0 +1,320 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <numeric>
+
+#include "../3rdparty/eigen/Eigen/Dense"
+#include "calibration.hpp"
+
+namespace blocks
+{
+
+// the runs of the candidates of an iteration, and their weighted errors
+class CandidateRuns
+{
+protected:
+    const Base&                       _model;
+    TimeCallback                      _time_cb;
+    InputCallback                     _inputs_cb;
+    NodeValues                        _parameters;
+    const std::vector<FreeParameter>& _free;
+    const std::vector<Reference>&     _references;
+    const CalibrationOptions&         _options;
+    Eigen::Index                      _n_residuals{0};
+
+public:
+    uint n_runs{0};
+
+    CandidateRuns(const Base& model, TimeCallback time_cb, InputCallback inputs_cb, const NodeValues& parameters,
+        const std::vector<FreeParameter>& free, const std::vector<Reference>& references,
+        const CalibrationOptions& options) :
+        _model(model), _time_cb(time_cb), _inputs_cb(inputs_cb), _parameters(parameters), _free(free),
+        _references(references), _options(options)
+    {
+        for (const auto& reference: _references)
+        {
+            assert(reference.t.size() == reference.y.size());
+            assert(std::is_sorted(reference.t.cbegin(), reference.t.cend()));
+            _n_residuals += reference.t.size();
+        }
+        for (const auto& p: _free)
+        {
+            if (_parameters.find(p.name) == _parameters.first.end())
+            {
+                std::cout << "-- not a parameter: " << p.name << "\n";
+                assert(false);
+            }
+            assert((p.lower < p.upper) and (p.element < _parameters.at(p.name).size()));
+        }
+    }
+
+    Eigen::Index n_residuals() const {return _n_residuals;}
+
+    VectorXd clip(VectorXd p) const
+    {
+        for (Eigen::Index j = 0; j < p.size(); j++)
+            p[j] = std::clamp(p[j], _free[j].lower, _free[j].upper);
+        return p;
+    }
+
+    NodeValues parameters(const VectorXd& p) const
+    {
+        NodeValues ret(_parameters);
+        for (Eigen::Index j = 0; j < p.size(); j++)
+        {
+            Value value = ret.at(_free[j].name);
+            value[_free[j].element] = p[j];
+            ret.insert_or_assign(_free[j].name, value);
+        }
+        return ret;
+    }
+
+    // the weighted residuals of each candidate
+    std::vector<VectorXd> residuals(const std::vector<VectorXd>& candidates)
+    {
+        std::vector<Scenario> scenarios;
+        for (const auto& p: candidates)
+            scenarios.push_back({_time_cb, _inputs_cb, parameters(p), _options.stepper, Observers(), true});
+        auto histories = branch(_model, scenarios, _options.n_threads);
+        n_runs += candidates.size();
+
+        std::vector<VectorXd> ret;
+        for (auto& history: histories)
+        {
+            const auto& t = history.at("t");
+            const auto n = t.rows();
+            VectorXd r(_n_residuals);
+            Eigen::Index i = 0;
+            for (const auto& reference: _references)
+            {
+                const auto& y = history.at(reference.signal);
+                assert(reference.column < y.cols());
+                const double w = std::sqrt(reference.weight);
+                for (std::size_t k = 0; k < reference.t.size(); k++)
+                {
+                    const double tk = reference.t[k];
+                    auto b = std::lower_bound(t.data(), t.data() + n, tk) - t.data();
+                    b = std::clamp<Eigen::Index>(b, 1, n - 1);
+                    const auto a = b - 1;
+                    const double alpha = (n == 1) ? 0.0 : std::clamp((tk - t(a, 0))/(t(b, 0) - t(a, 0)), 0.0, 1.0);
+                    const double simulated = (n == 1) ? y(0, reference.column) :
+                        (1 - alpha)*y(a, reference.column) + alpha*y(b, reference.column);
+                    r[i++] = w*(simulated - reference.y[k]);
+                }
+            }
+            ret.push_back(std::move(r));
+        }
+        return ret;
+    }
+
+    std::vector<double> costs(const std::vector<VectorXd>& candidates)
+    {
+        std::vector<double> ret;
+        for (const auto& r: residuals(candidates))
+            ret.push_back(0.5*r.squaredNorm());
+        return ret;
+    }
+};
+
+static bool converged(double cost, double new_cost, const VectorXd& p, const VectorXd& step, double tolerance)
+{
+    return (cost - new_cost <= tolerance*std::max(cost, std::numeric_limits<double>::min())) or
+        (step.norm() <= tolerance*(1 + p.norm()));
+}
+
+// each iteration runs the finite-difference columns of the Jacobian together, and then a few
+//   damping factors together, keeping the best one
+static CalibrationResult levenberg_marquardt(CandidateRuns& evaluator, const std::vector<FreeParameter>& free,
+    const VectorXd& p0, const CalibrationOptions& options)
+{
+    const auto n = p0.size();
+    VectorXd p = evaluator.clip(p0);
+    double lambda = 1e-3;
+
+    CalibrationResult ret{NodeValues(), 0.0, 0, 0, false};
+    for (; ret.iterations < options.max_iterations; ret.iterations++)
+    {
+        // forward differences, backward at an upper bound
+        std::vector<VectorXd> candidates{p};
+        VectorXd h(n);
+        for (Eigen::Index j = 0; j < n; j++)
+        {
+            h[j] = options.fd_step*std::max(std::abs(p[j]), free[j].upper - free[j].lower);
+            if (p[j] + h[j] > free[j].upper)
+                h[j] = -h[j];
+            candidates.push_back(p);
+            candidates.back()[j] += h[j];
+        }
+        auto residuals = evaluator.residuals(candidates);
+        const VectorXd& r = residuals.front();
+        const double cost = 0.5*r.squaredNorm();
+        ret.cost = cost;
+
+        MatrixXd J(r.size(), n);
+        for (Eigen::Index j = 0; j < n; j++)
+            J.col(j) = (residuals[j + 1] - r)/h[j];
+        MatrixXd A = J.transpose()*J;
+        VectorXd g = J.transpose()*r;
+        const VectorXd d = A.diagonal().cwiseMax(1e-12*A.diagonal().maxCoeff()).cwiseMax(std::numeric_limits<double>::min());
+
+        // a parameter at a bound that the cost pushes it past stays there
+        for (Eigen::Index j = 0; j < n; j++)
+        {
+            if (((p[j] <= free[j].lower) and (g[j] > 0)) or ((p[j] >= free[j].upper) and (g[j] < 0)))
+            {
+                A.row(j).setZero();
+                A.col(j).setZero();
+                A(j, j) = 1;
+                g[j] = 0;
+            }
+        }
+
+        bool accepted = false;
+        while (not accepted and (lambda < 1e16))
+        {
+            std::vector<double> lambdas{lambda, 8*lambda, 64*lambda};
+            std::vector<VectorXd> trials;
+            for (auto l: lambdas)
+            {
+                MatrixXd M = A;
+                M.diagonal() += l*d;
+                trials.push_back(evaluator.clip(p + M.ldlt().solve(-g)));
+            }
+            auto costs = evaluator.costs(trials);
+            auto best = std::min_element(costs.cbegin(), costs.cend()) - costs.cbegin();
+            if (costs[best] < cost)
+            {
+                accepted = true;
+                const VectorXd step = trials[best] - p;
+                const bool done = converged(cost, costs[best], p, step, options.tolerance);
+                p = trials[best];
+                ret.cost = costs[best];
+                lambda = std::max(lambdas[best]/8, 1e-12);
+                if (done)
+                {
+                    ret.converged = true;
+                    ret.iterations++;
+                    ret.parameters = evaluator.parameters(p);
+                    ret.n_runs = evaluator.n_runs;
+                    return ret;
+                }
+            }
+            else
+                lambda *= 512;
+        }
+        if (not accepted)
+        {
+            // no step decreases the cost: a (local) minimum within the bounds
+            ret.converged = true;
+            break;
+        }
+    }
+
+    ret.parameters = evaluator.parameters(p);
+    ret.n_runs = evaluator.n_runs;
+    return ret;
+}
+
+// the candidates of both the serial decisions (reflection, then expansion or a contraction) are
+//   run together, and the points of a shrink too
+static CalibrationResult nelder_mead(CandidateRuns& evaluator, const std::vector<FreeParameter>& free, const VectorXd& p0,
+    const CalibrationOptions& options)
+{
+    const auto n = p0.size();
+    std::vector<VectorXd> points{evaluator.clip(p0)};
+    for (Eigen::Index j = 0; j < n; j++)
+    {
+        VectorXd p = points.front();
+        const double step = options.simplex_size*(free[j].upper - free[j].lower);
+        p[j] += (p[j] + step <= free[j].upper) ? step : -step;
+        points.push_back(p);
+    }
+    auto costs = evaluator.costs(points);
+
+    CalibrationResult ret{NodeValues(), 0.0, 0, 0, false};
+    std::vector<std::size_t> order(points.size());
+    auto sort = [&]() -> void
+    {
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {return costs[a] < costs[b];});
+    };
+
+    for (; ret.iterations < options.max_iterations; ret.iterations++)
+    {
+        sort();
+        const auto best = order.front(), worst = order.back(), second = order[order.size() - 2];
+        const double spread = costs[worst] - costs[best];
+        if (spread <= options.tolerance*std::max(costs[best], std::numeric_limits<double>::min()))
+        {
+            ret.converged = true;
+            break;
+        }
+
+        VectorXd centroid = VectorXd::Zero(n);
+        for (std::size_t k = 0; k < points.size(); k++)
+            if (k != worst)
+                centroid += points[k]/n;
+        const VectorXd direction = centroid - points[worst];
+        std::vector<VectorXd> trials{
+            evaluator.clip(centroid + direction),        // reflection
+            evaluator.clip(centroid + 2*direction),      // expansion
+            evaluator.clip(centroid + 0.5*direction),    // outside contraction
+            evaluator.clip(centroid - 0.5*direction)};   // inside contraction
+        auto c = evaluator.costs(trials);
+
+        std::size_t accepted = trials.size();
+        if (c[0] < costs[best])
+            accepted = (c[1] < c[0]) ? 1 : 0;
+        else if (c[0] < costs[second])
+            accepted = 0;
+        else if (c[0] < costs[worst])
+            accepted = (c[2] <= c[0]) ? 2 : trials.size();
+        else if (c[3] < costs[worst])
+            accepted = 3;
+
+        if (accepted < trials.size())
+        {
+            points[worst] = trials[accepted];
+            costs[worst] = c[accepted];
+            continue;
+        }
+
+        // shrink towards the best point
+        std::vector<VectorXd> shrunk;
+        for (std::size_t k = 0; k < points.size(); k++)
+            if (k != best)
+                shrunk.push_back(points[best] + 0.5*(points[k] - points[best]));
+        auto shrunk_costs = evaluator.costs(shrunk);
+        for (std::size_t k = 0, i = 0; k < points.size(); k++)
+            if (k != best)
+            {
+                points[k] = shrunk[i];
+                costs[k] = shrunk_costs[i++];
+            }
+    }
+
+    sort();
+    ret.cost = costs[order.front()];
+    ret.parameters = evaluator.parameters(points[order.front()]);
+    ret.n_runs = evaluator.n_runs;
+    return ret;
+}
+
+CalibrationResult calibrate(const Base& model, TimeCallback time_cb, InputCallback inputs_cb,
+    const NodeValues& parameters, const std::vector<FreeParameter>& free, const std::vector<Reference>& references,
+    const CalibrationOptions& options)
+{
+    assert(not free.empty());
+    CandidateRuns evaluator(model, time_cb, inputs_cb, parameters, free, references, options);
+
+    VectorXd p0(free.size());
+    for (std::size_t j = 0; j < free.size(); j++)
+        p0[j] = parameters.at(free[j].name)[free[j].element];
+
+    if (options.method == CalibrationOptions::Method::nelder_mead)
+        return nelder_mead(evaluator, free, p0, options);
+    return levenberg_marquardt(evaluator, free, p0, options);
+}
+
+}
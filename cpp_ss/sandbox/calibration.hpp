@@ -0,0 +1,66 @@
+#ifndef __CALIBRATION_HPP__
+#define __CALIBRATION_HPP__
+
+#include <vector>
+
+#include "blocks.hpp"
+#include "helper.hpp"
+#include "solver.hpp"
+
+namespace blocks
+{
+
+// an element of a parameter to fit, kept within [lower, upper]
+struct FreeParameter
+{
+    Node         name;
+    double       lower;
+    double       upper;
+    Eigen::Index element{0};
+};
+
+// the values a column of a recorded signal should have at the times t, the simulated ones being
+//   interpolated linearly
+struct Reference
+{
+    Node                signal;
+    std::vector<double> t;
+    std::vector<double> y;
+    double              weight{1.0};
+    Eigen::Index        column{0};
+};
+
+struct CalibrationOptions
+{
+    enum class Method {levenberg_marquardt, nelder_mead};
+
+    Method method{Method::levenberg_marquardt};
+    Solver stepper{rk4};
+    uint   max_iterations{100};
+    double tolerance{1e-10};    // on the relative decrease of the cost, and on the relative step
+    double fd_step{1e-6};       // of the finite differences, relative to the value or the range
+    double simplex_size{0.1};   // of the initial simplex, relative to the ranges
+    uint   n_threads{0};        // 0: one per core
+};
+
+struct CalibrationResult
+{
+    NodeValues parameters;  // all of them, with the fitted values
+    double     cost;        // half the weighted sum of the squared errors
+    uint       iterations;
+    uint       n_runs;
+    bool       converged;
+};
+
+// fits the free parameters so that the simulated signals follow the references. each candidate
+//   is a run of a clone of the model from its current state, and the candidates an iteration
+//   needs (the finite-difference columns and damping factors of Levenberg-Marquardt, the
+//   reflection, expansion and contractions of Nelder-Mead) are run concurrently, with branch().
+//   parameters holds the initial values of the free ones and the values of the others.
+CalibrationResult calibrate(const Base& model, TimeCallback time_cb, InputCallback inputs_cb,
+    const NodeValues& parameters, const std::vector<FreeParameter>& free, const std::vector<Reference>& references,
+    const CalibrationOptions& options=CalibrationOptions());
+
+}
+
+#endif // __CALIBRATION_HPP__
@@ -2,7 +2,11 @@
 #ifndef __GP_IOS_HPP__
 #define __GP_IOS_HPP__
 
+#include <utility>
+#include <vector>
+
 #include "blocks.hpp"
+#include "helper.hpp"
 
 #include "../3rdparty/eigen/Eigen/Core"
 #include "gnuplot-iostream.h"
@@ -34,4 +38,16 @@ template<> std::string Gnuplot::file1d(const MatrixXd &arg, const std::string &f
 
 }
 
+// the (t, y) rows of downsample() as a binary file for a plot command, e.g.
+//   gp << "plot" << binary_plot(gp, downsample(history["t"], history["x"], 0, 1000)) << "with lines"
+//   plots x against t, unlike file1d() which plots every sample against its index
+inline std::string binary_plot(Gnuplot& gp, const MatrixXd& points)
+{
+    assert(points.cols() == 2);
+    std::vector<std::pair<double, double>> rows(points.rows());
+    for (Eigen::Index k = 0; k < points.rows(); k++)
+        rows[k] = {points(k, 0), points(k, 1)};
+    return gp.binFile1d(rows, "record");
+}
+
 #endif // __GP_IOS_HPP__
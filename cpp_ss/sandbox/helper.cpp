@@ -1,111 +1,192 @@
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <sstream>
+#include <thread>
+#include <tuple>
 
 #include "blocks.hpp"
 #include "helper.hpp"
+#include "schedule.hpp"
 
 namespace blocks
 {
 
-History run(Base& model, TimeCallback time_cb, InputCallback inputs_cb, const NodeValues& parameters, Solver stepper)
+// collects the points of a run, and builds its history out of them once it's over
+class HistoryRecorder : public Observer
 {
-    auto process = [](Base& model, double t, NodeValues& x) -> uint
+protected:
+    History&                  _history;
+    Nodes                     _names;
+    std::vector<Eigen::Index> _sizes;
+    std::vector<double>       _rows;  // t and the values of each point
+
+public:
+    HistoryRecorder(History& history) : _history(history) {}
+
+    void start(const Nodes& names, const std::vector<Eigen::Index>& sizes) override
     {
-        uint n_processed = model._process(t, x, true);
-        uint n;
-        do
-        {
-            n = model._process(t, x, false);
-            n_processed += n;
-        } while(n);
+        _names = names;
+        _sizes = sizes;
+    }
 
-        std::vector<const Base*> unprocessed;
+    void observe(uint /*k*/, double t, const RecordValues& values) override
+    {
+        _rows.push_back(t);
+        _rows.insert(_rows.end(), values.data(), values.data() + values.size());
+    }
 
-        auto find_unprocessed_cb = [&] (const Base& c) -> bool
-        {
-            if (not c.is_processed())
-                unprocessed.push_back(&c);
-            return true;
-        };
+    void finish() override
+    {
+        const Eigen::Index width = 1 + std::accumulate(_sizes.cbegin(), _sizes.cend(), Eigen::Index(0));
+        const Map<const Matrix<double, Dynamic, Dynamic, RowMajor>> rows(_rows.data(), _rows.size()/width, width);
 
-        model.traverse(find_unprocessed_cb);
-        if (unprocessed.size())
+        _history.insert_or_assign("t", MatrixXd(rows.leftCols<1>()));
+        Eigen::Index offset = 1;
+        for (std::size_t k = 0; k < _names.size(); k++)
         {
-            std::cout << "-- unprocessed blocks detected:\n";
-            for (const auto& c: unprocessed)
-            {
-                std::cout << "- " << c->name() << "\n";
-                for (const auto& p: c->iports())
-                    std::cout << "  - i: " << (x.find(p) == x.first.end() ? "*" : " ") <<  p << "\n";
-                for (const auto& p: c->oports())
-                    std::cout << "  - o: " << (x.find(p) == x.first.end() ? "*" : " ") <<  p << "\n";
-            }
+            _history.insert_or_assign(_names[k], MatrixXd(rows.middleCols(offset, _sizes[k])));
+            offset += _sizes[k];
         }
-        return n_processed;
-    };
+        _rows = std::vector<double>();
+    }
+};
+
+const Observers& default_observers()
+{
+    static const Observers observers{std::make_shared<ProgressObserver>()};
+    return observers;
+}
 
+static History run(Base& model, TimeCallback time_cb, InputCallback inputs_cb, const InputSources& sources,
+    const NodeValues& parameters, Solver stepper, const Nodes& sensitivities, uint n_threads, const Observers& observers,
+    bool keep_history=true)
+{
     History history;
     NodeValues inputs;
 
     States states;
     model.get_states(states);
 
+    // compiled on the first evaluation, once the inputs are known
+    std::unique_ptr<Schedule> schedule;
+
     auto stepper_callback = [&](double t, const NodeValues& x) -> Values
     {
-        NodeValues y(x);
-
-        y.join(parameters);
-        y.join(inputs);
-
-        process(model, t, y);
-
-        Values ret;
-        ret.reserve(x.first.size());
-        for (const auto& state: std::get<2>(states))
-        {
-            auto& deriv = y.at(state);
-            ret.push_back(deriv);
-        }
+        schedule->evaluate_derivatives(t, x);
+        return schedule->derivatives();
+    };
 
-        return ret;
+    auto zc_callback = [&](double t, const NodeValues& x) -> Scalars
+    {
+        schedule->evaluate_derivatives(t, x);
+        return schedule->zero_crossings(t);
     };
 
     NodeValues x(std::get<0>(states), std::get<1>(states));
 
-    auto update_history = [&](double t, const NodeValues& x, const NodeValues& inputs) -> void
+    // the sensitivities of the states are integrated along with them, starting from zero
+    Eigen::Index n_directions = 0;
+    for (const auto& parameter: sensitivities)
+        n_directions += parameters.at(parameter).size();
+    if (n_directions)
     {
-        NodeValues y(x);
+        const auto n = x.first.size();
+        for (std::size_t k = 0; k < n; k++)
+        {
+            x.first.push_back("d(" + x.first[k] + ")/dp");
+            x.second.push_back(Value::Zero(x.second[k].size()*n_directions));
+        }
+    }
 
-        y.join(parameters);
-        y.join(inputs);
+    // the values of a point go to the observers, the history being built by one of them
+    std::vector<uint> recorded;
+    std::vector<std::tuple<uint, Eigen::Index, Eigen::Index>> recorded_sensitivities;
+    std::unique_ptr<ObserverPipeline> pipeline;
+    uint n_recorded = 0;
+    // the last point isn't stepped past, only its states are kept: a run going on from where this
+    //   one stops (from a checkpoint, or a branch) records that point again and steps it then
+    auto update_history = [&](double t, const NodeValues& x, const NodeValues& inputs, bool last) -> void
+    {
+        if (not schedule)
+        {
+            auto input_nodes = inputs.first;
+            for (const auto& [input, source]: sources)
+                input_nodes.push_back(input);
+            schedule = std::make_unique<Schedule>(model, states, parameters, input_nodes);
+            for (const auto& [input, source]: sources)
+                schedule->set_input_source(input, source);
+            schedule->set_threads(n_threads);
+            if (n_directions)
+                schedule->set_sensitivities(sensitivities);
+        }
 
-        process(model, t, y);
+        schedule->set_inputs(inputs);
+        schedule->evaluate(t, x);
 
-        model.step(t, y);
+        if (last)
+            model.set_states(x);
+        else
+            schedule->step(t);
+        const auto& y = schedule->signals();
 
-        if (history.empty())
+        if (not pipeline)
         {
-            history.insert_or_assign("t", Value());
-            for (const auto& v: y.first)
-                if ((parameters.find(v) ==  parameters.first.end()) && (v[0] != '-'))
-                    history.insert_or_assign(v, Value());
+            Nodes names;
+            std::vector<Eigen::Index> sizes;
+            for (uint k = 0; k < y.first.size(); k++)
+            {
+                const auto& v = y.first[k];
+                if ((not schedule->is_parameter(k)) && (v[0] != '-'))
+                {
+                    const auto n = y.second[k].size();
+                    recorded.push_back(k);
+                    names.push_back(v);
+                    sizes.push_back(n);
+
+                    // d(v)/d(p): one column per element of v and of p, column-major
+                    Eigen::Index offset = 0;
+                    for (const auto& p: sensitivities)
+                    {
+                        const auto m = parameters.at(p).size();
+                        recorded_sensitivities.emplace_back(k, offset, m);
+                        names.push_back("d(" + v + ")/d(" + p + ")");
+                        sizes.push_back(n*m);
+                        offset += m;
+                    }
+                }
+            }
+
+            auto all_observers = ((&observers == &default_observers()) and std::get<0>(states).empty()) ?
+                Observers() : observers;
+            if (keep_history)
+                all_observers.insert(all_observers.begin(), std::make_shared<HistoryRecorder>(history));
+            pipeline = std::make_unique<ObserverPipeline>(all_observers, names, sizes);
         }
 
-        auto& h = history["t"];
-        auto nrows = h.rows() + 1;
-        h.conservativeResize(nrows, NoChange);
-        h(nrows - 1, 0) = t;
-        uint k = 0;
-        for (const auto& v: y.first)
+        // in the order of the names: each node followed by its sensitivities
+        double* values = pipeline->record(n_recorded++, t);
+        auto sensitivity = recorded_sensitivities.cbegin();
+        for (auto k: recorded)
         {
-            if ((parameters.find(v) ==  parameters.first.end()) && (v[0] != '-'))
+            const auto& value = y.second[k];
+            std::copy(value.data(), value.data() + value.size(), values);
+            values += value.size();
+            for (; (sensitivity != recorded_sensitivities.cend()) and (std::get<0>(*sensitivity) == k); sensitivity++)
             {
-                auto& h = history[v];
-                h.conservativeResize(nrows, NoChange);
-                history[v].bottomRows<1>() = y.at(v);
+                const auto& [_, offset, m] = *sensitivity;
+                const Tangent tangent = schedule->tangent(k).middleCols(offset, m);
+                std::copy(tangent.data(), tangent.data() + tangent.size(), values);
+                values += tangent.size();
             }
-            k++;
         }
+        pipeline->commit();
     };
 
     if (std::get<0>(states).size())
@@ -113,11 +194,10 @@ History run(Base& model, TimeCallback time_cb, InputCallback inputs_cb, const No
         assert(stepper);
         uint k = 0;
         double t, t1;
+        double t_event = std::numeric_limits<double>::quiet_NaN();  // the last one restarted from
+        Scalars zc0;
         while (time_cb(k, t1))
         {
-            if (k%100 == 0)
-                std::cout << k << ": " << t1 << "\n";
-
             if (k == 0)
             {
                 t = t1;
@@ -127,31 +207,82 @@ History run(Base& model, TimeCallback time_cb, InputCallback inputs_cb, const No
 
             if (inputs_cb)
                 inputs_cb(t, x, inputs);
-            update_history(t, x, inputs);
-            x = stepper(stepper_callback, t, t1, x);
+            update_history(t, x, inputs, false);
+
+            // the zero crossings at (t, x), from the recording evaluation. one that is exactly zero
+            //   keeps its previous sign, so that a switch right at t is not missed
+            if (schedule->has_zero_crossings())
+            {
+                auto zc = schedule->zero_crossings(t);
+                for (std::size_t n = 0; n < std::min(zc.size(), zc0.size()); n++)
+                    if (zc[n] == 0)
+                        zc[n] = zc0[n];
+                zc0 = zc;
+            }
+
+            // the recording evaluation at (t, x) doubles as the first stage of the step, unless
+            //   stepping the model changed what the derivatives depend on (e.g. a Memory)
+            if (schedule->step_changes_derivatives())
+                schedule->evaluate_derivatives(t, x);
+            auto dx = schedule->derivatives();
+            auto x1 = stepper(stepper_callback, t, t1, x, dx);
+
+            // on an event, integration restarts from right after it and the step to t1 is retried,
+            //   unless the event is (almost) at t1. a crossing located (almost) at t, right after
+            //   the event the step restarted from, is that same event.
+            if (schedule->has_zero_crossings())
+            {
+                const double eps = 1e-6*(t1 - t);
+                double te = t1;
+                auto xe = x1;
+                if (locate_event(stepper, stepper_callback, zc_callback, t, x, dx, zc0, te, xe) and
+                    (t1 - te > eps) and ((t != t_event) or (te - t > eps)))
+                {
+                    x = xe;
+                    t = t_event = te;
+                    continue;
+                }
+            }
+
+            x = x1;
             t = t1;
             k++;
         }
         if (inputs_cb)
             inputs_cb(t, x, inputs);
-        update_history(t, x, inputs);
+        update_history(t, x, inputs, true);
     }
     else
     {
+        // without states, there is nothing to solve: recording evaluates the model
         uint k = 0;
-        double t;
-        while (time_cb(k++, t))
+        double t, t_next;
+        for (bool more = time_cb(k++, t); more; t = t_next)
         {
+            more = time_cb(k++, t_next);
             if (inputs_cb)
                 inputs_cb(t, x, inputs);
-            x.second = stepper_callback(t, x);
-            update_history(t, x, inputs);
+            update_history(t, x, inputs, not more);
         }
     }
 
+    if (pipeline)
+        pipeline->finish();
     return history;
 }
 
+History run(Base& model, TimeCallback time_cb, InputCallback inputs_cb, const NodeValues& parameters, Solver stepper,
+    const Nodes& sensitivities, uint n_threads, const Observers& observers)
+{
+    return run(model, time_cb, inputs_cb, InputSources(), parameters, stepper, sensitivities, n_threads, observers);
+}
+
+History run(Base& model, TimeCallback time_cb, const InputSources& sources, const NodeValues& parameters, Solver stepper,
+    const Nodes& sensitivities, uint n_threads, const Observers& observers)
+{
+    return run(model, time_cb, nullptr, sources, parameters, stepper, sensitivities, n_threads, observers);
+}
+
 // def load_mat_files_as_bus(root, prefix):
 //     prefix += "."
 //     ret = {}
@@ -193,6 +324,243 @@ History run(Base& model, TimeCallback time_cb, InputCallback inputs_cb, const No
 //     traverse(dct, ret)
 //     return ret
 
+static constexpr char CHECKPOINT_MAGIC[] = "SSCK";
+static constexpr std::uint32_t CHECKPOINT_VERSION = 2;  // 2: vector-valued Integrator states
+
+void checkpoint(const Base& model, std::ostream& os)
+{
+    // only the blocks that have a state are written, each one as: name, size, state
+    std::vector<std::pair<std::string, std::string>> records;
+    model.traverse([&](const Base& block) -> bool
+        {
+            std::ostringstream state;
+            block.save_state(state);
+            if (state.tellp() > 0)
+                records.emplace_back(block.name(), state.str());
+            return true;
+        });
+
+    os.write(CHECKPOINT_MAGIC, 4);
+    write_binary(os, CHECKPOINT_VERSION);
+    write_binary(os, std::uint64_t(records.size()));
+    for (const auto& [name, state]: records)
+    {
+        write_binary(os, name);
+        write_binary(os, state);
+    }
+}
+
+void restore(Base& model, std::istream& is)
+{
+    char magic[4];
+    is.read(magic, 4);
+    assert(std::equal(magic, magic + 4, CHECKPOINT_MAGIC));
+    std::uint32_t version;
+    read_binary(is, version);
+    assert(version == CHECKPOINT_VERSION);
+
+    std::map<std::string, Base*> blocks;
+    std::function<void(Base&)> collect = [&](Base& block) -> void
+    {
+        if (auto* submodel = dynamic_cast<Submodel*>(&block))
+        {
+            for (auto* component: submodel->components())
+                collect(*component);
+        }
+        else
+            blocks.emplace(block.name(), &block);
+    };
+    collect(model);
+
+    std::uint64_t n;
+    read_binary(is, n);
+    std::string name, state;
+    while (n--)
+    {
+        read_binary(is, name);
+        read_binary(is, state);
+        auto it = blocks.find(name);
+        assert(it != blocks.end());
+        std::istringstream ss(state);
+        it->second->load_state(ss);
+    }
+    assert(is.good());
+}
+
+std::vector<History> branch(const Base& model, const std::vector<Scenario>& scenarios, uint n_threads)
+{
+    std::vector<History> histories(scenarios.size());
+
+    // the clones are made upfront since cloning reads the model
+    std::vector<std::unique_ptr<Base>> models;
+    models.reserve(scenarios.size());
+    for (std::size_t k = 0; k < scenarios.size(); k++)
+        models.emplace_back(model.clone());
+
+    if (n_threads == 0)
+        n_threads = std::max(1u, std::thread::hardware_concurrency());
+    n_threads = std::min<std::size_t>(n_threads, scenarios.size());
+
+    std::atomic<std::size_t> next{0};
+    auto worker = [&]() -> void
+    {
+        for (std::size_t k = next++; k < scenarios.size(); k = next++)
+        {
+            const auto& s = scenarios[k];
+            histories[k] = run(*models[k], s.time_cb, s.inputs_cb, InputSources(), s.parameters, s.stepper, Nodes(), 1,
+                s.observers, s.keep_history);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (uint k = 1; k < n_threads; k++)
+        threads.emplace_back(worker);
+    worker();
+    for (auto& thread: threads)
+        thread.join();
+
+    return histories;
+}
+
+LinearModel linearize(const Base& model, double t, const NodeValues& x0, const NodeValues& u0, const Nodes& inputs,
+    const Nodes& outputs, const NodeValues& parameters, uint n_threads)
+{
+    // each thread perturbs its own copy of the model around the same operating point
+    struct Evaluator
+    {
+        std::unique_ptr<Base>     model;
+        States                    states;
+        NodeValues                x;
+        std::unique_ptr<Schedule> schedule;
+    };
+
+    auto make_evaluator = [&]() -> Evaluator
+    {
+        Evaluator e;
+        e.model.reset(model.clone());
+        e.model->get_states(e.states);
+        e.x = NodeValues(std::get<0>(e.states), std::get<1>(e.states));
+        auto value = x0.second.begin();
+        for (const auto& state: x0.first)
+        {
+            assert(e.x.find(state) != e.x.first.end());
+            e.x.insert_or_assign(state, *(value++));
+        }
+        e.schedule = std::make_unique<Schedule>(*e.model, e.states, parameters, u0.first);
+        e.schedule->set_inputs(u0);
+        e.schedule->evaluate(t, e.x);
+        return e;
+    };
+
+    // the layout, from the nominal evaluation
+    auto nominal = make_evaluator();
+    const auto& y0 = nominal.schedule->signals();
+
+    // (node, element) of each flattened column or row
+    using Elements = std::vector<std::pair<uint, Eigen::Index>>;
+    auto flatten = [&](const Nodes& nodes) -> Elements
+    {
+        Elements ret;
+        for (const auto& node: nodes)
+        {
+            auto k = nominal.schedule->index(node);
+            for (Eigen::Index n = 0; n < y0.second[k].size(); n++)
+                ret.emplace_back(k, n);
+        }
+        return ret;
+    };
+
+    LinearModel ret;
+    ret.states = nominal.x.first;
+    for (const auto& input: inputs)
+        assert(u0.find(input) != u0.first.end());
+    auto x_elements = flatten(ret.states);
+    auto u_elements = flatten(inputs);
+    auto y_elements = flatten(outputs);
+    auto dx_elements = flatten(std::get<2>(nominal.states));
+
+    const Eigen::Index nx = x_elements.size();
+    const Eigen::Index nu = u_elements.size();
+    const Eigen::Index ny = y_elements.size();
+    ret.A = MatrixXd::Zero(nx, nx);
+    ret.B = MatrixXd::Zero(nx, nu);
+    ret.C = MatrixXd::Zero(ny, nx);
+    ret.D = MatrixXd::Zero(ny, nu);
+
+    const std::size_t n_columns = nx + nu;
+    if (n_threads == 0)
+        n_threads = std::max(1u, std::thread::hardware_concurrency());
+    n_threads = std::min<std::size_t>(n_threads, n_columns);
+
+    std::atomic<std::size_t> next{0};
+    auto worker = [&](Evaluator& e) -> void
+    {
+        auto& signals = e.schedule->signals();
+        auto read = [&](const Elements& elements) -> VectorXd
+        {
+            VectorXd values(elements.size());
+            for (std::size_t n = 0; n < elements.size(); n++)
+                values[n] = signals.second[elements[n].first][elements[n].second];
+            return values;
+        };
+
+        for (std::size_t j = next++; j < n_columns; j = next++)
+        {
+            const bool is_state = j < std::size_t(nx);
+            const auto& column = is_state ? x_elements[j] : u_elements[j - nx];
+            const uint signal = column.first;
+            const Eigen::Index element = column.second;
+
+            // nothing to evaluate if the perturbation reaches no block, e.g. a state only fed back
+            //   through integrators
+            auto cone = e.schedule->forward_cone({signal});
+
+            Value v = signals.second[signal];
+            const double v0 = v[element];
+            const double h = std::cbrt(std::numeric_limits<double>::epsilon())*std::max(1.0, std::abs(v0));
+            auto evaluate_at = [&](double value) -> void
+            {
+                v[element] = value;
+                if (is_state)
+                    e.x.second[std::distance(e.x.first.cbegin(), e.x.find(signals.first[signal]))] = v;
+                else
+                    e.schedule->set_inputs(NodeValues({{signals.first[signal], v}}));
+                e.schedule->evaluate_entries(t, e.x, cone);
+            };
+
+            evaluate_at(v0 + h);
+            VectorXd dx = read(dx_elements), y = read(y_elements);
+            evaluate_at(v0 - h);
+            dx = (dx - read(dx_elements))/(2*h);
+            y = (y - read(y_elements))/(2*h);
+            evaluate_at(v0);
+
+            if (is_state)
+            {
+                ret.A.col(j) = dx;
+                ret.C.col(j) = y;
+            }
+            else
+            {
+                ret.B.col(j - nx) = dx;
+                ret.D.col(j - nx) = y;
+            }
+        }
+    };
+
+    std::vector<Evaluator> evaluators;
+    for (uint k = 1; k < n_threads; k++)
+        evaluators.push_back(make_evaluator());
+    std::vector<std::thread> threads;
+    for (auto& e: evaluators)
+        threads.emplace_back(worker, std::ref(e));
+    worker(nominal);
+    for (auto& thread: threads)
+        thread.join();
+
+    return ret;
+}
+
 bool arange(uint k, double& t, double t_init, double t_end, double dt)
 {
     if (k < 0)
@@ -201,4 +569,134 @@ bool arange(uint k, double& t, double t_init, double t_end, double dt)
     return t <= t_end;
 }
 
+static MatrixXd downsample_minmax(const Ref<const VectorXd>& t, const Ref<const VectorXd>& y, Eigen::Index begin, Eigen::Index end,
+    uint n_pixels)
+{
+    std::vector<Eigen::Index> kept;
+    kept.reserve(4*n_pixels);
+
+    const double t0 = t[begin];
+    const double width = (t[end - 1] - t0)/n_pixels;
+    for (Eigen::Index a = begin, b; a < end; a = b)
+    {
+        // the samples of the pixel of sample a
+        const double t_next = t0 + (std::floor((t[a] - t0)/width) + 1)*width;
+        b = std::lower_bound(t.data() + a, t.data() + end, t_next) - t.data();
+        b = std::max(b, a + 1);
+
+        Eigen::Index i_min, i_max;
+        y.segment(a, b - a).minCoeff(&i_min);
+        y.segment(a, b - a).maxCoeff(&i_max);
+        for (auto i: {a, a + std::min(i_min, i_max), a + std::max(i_min, i_max), b - 1})
+            if (kept.empty() or (i > kept.back()))
+                kept.push_back(i);
+    }
+
+    MatrixXd ret(kept.size(), 2);
+    for (std::size_t k = 0; k < kept.size(); k++)
+        ret.row(k) << t[kept[k]], y[kept[k]];
+    return ret;
+}
+
+static MatrixXd downsample_lttb(const Ref<const VectorXd>& t, const Ref<const VectorXd>& y, Eigen::Index begin, Eigen::Index end,
+    uint n_pixels)
+{
+    const Eigen::Index n = end - begin;
+    if (n <= n_pixels)
+    {
+        MatrixXd ret(n, 2);
+        ret << t.segment(begin, n), y.segment(begin, n);
+        return ret;
+    }
+
+    // too few pixels for a bucket between the first and last samples, which are all that is kept
+    if (n_pixels < 3)
+    {
+        MatrixXd ret(2, 2);
+        ret << t[begin], y[begin], t[end - 1], y[end - 1];
+        return ret;
+    }
+
+    // the first and last samples are kept, the others are split into n_pixels - 2 buckets of
+    //   which one sample each is kept: the one making the largest triangle with the sample kept
+    //   before it and the average of the next bucket
+    MatrixXd ret(n_pixels, 2);
+    ret.row(0) << t[begin], y[begin];
+    const double size = double(n - 2)/(n_pixels - 2);
+    auto bucket = [&](uint k) -> Eigen::Index {return begin + 1 + Eigen::Index(k*size);};
+
+    Eigen::Index a = begin;
+    for (uint k = 0; k < n_pixels - 2; k++)
+    {
+        const Eigen::Index b0 = bucket(k), b1 = bucket(k + 1);
+        const Eigen::Index c0 = b1, c1 = (k + 2 < n_pixels - 1) ? bucket(k + 2) : end;
+        const double tc = t.segment(c0, c1 - c0).mean();
+        const double yc = y.segment(c0, c1 - c0).mean();
+
+        Eigen::Index i;
+        ((t[a] - tc)*(y.segment(b0, b1 - b0).array() - y[a]) -
+            (t[a] - t.segment(b0, b1 - b0).array())*(yc - y[a])).abs().maxCoeff(&i);
+        a = b0 + i;
+        ret.row(k + 1) << t[a], y[a];
+    }
+    ret.row(n_pixels - 1) << t[end - 1], y[end - 1];
+    return ret;
+}
+
+MatrixXd downsample(const MatrixXd& t, const MatrixXd& y, Eigen::Index column, uint n_pixels, Downsampling method,
+    double t_begin, double t_end)
+{
+    assert((t.cols() == 1) and (t.rows() == y.rows()) and (column < y.cols()));
+    assert(n_pixels > 0);
+
+    const Map<const VectorXd> tv(t.data(), t.rows());
+    const Map<const VectorXd> yv(y.col(column).data(), y.rows());
+    const Eigen::Index begin = std::lower_bound(tv.data(), tv.data() + tv.size(), t_begin) - tv.data();
+    const Eigen::Index end = std::upper_bound(tv.data(), tv.data() + tv.size(), t_end) - tv.data();
+    if (end - begin <= 2)
+    {
+        MatrixXd ret(end - begin, 2);
+        ret << tv.segment(begin, end - begin), yv.segment(begin, end - begin);
+        return ret;
+    }
+
+    if ((method == Downsampling::lttb) or (tv[end - 1] == tv[begin]))
+        return downsample_lttb(tv, yv, begin, end, n_pixels);
+    return downsample_minmax(tv, yv, begin, end, n_pixels);
+}
+
+std::vector<MatrixXd> downsample(const History& history, const Nodes& signals, uint n_pixels, Downsampling method,
+    double t_begin, double t_end, uint n_threads)
+{
+    const auto& t = history.at("t");
+    std::vector<std::pair<const MatrixXd*, Eigen::Index>> columns;
+    for (const auto& signal: signals)
+    {
+        const auto& y = history.at(signal);
+        for (Eigen::Index c = 0; c < y.cols(); c++)
+            columns.emplace_back(&y, c);
+    }
+
+    if (n_threads == 0)
+        n_threads = std::max(1u, std::thread::hardware_concurrency());
+    n_threads = std::min<std::size_t>(n_threads, columns.size());
+
+    std::vector<MatrixXd> ret(columns.size());
+    std::atomic<std::size_t> next{0};
+    auto worker = [&]() -> void
+    {
+        for (std::size_t k = next++; k < columns.size(); k = next++)
+            ret[k] = downsample(t, *columns[k].first, columns[k].second, n_pixels, method, t_begin, t_end);
+    };
+
+    std::vector<std::thread> threads;
+    for (uint k = 1; k < n_threads; k++)
+        threads.emplace_back(worker);
+    worker();
+    for (auto& thread: threads)
+        thread.join();
+
+    return ret;
+}
+
 }
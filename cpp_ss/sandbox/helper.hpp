@@ -2,9 +2,13 @@
 #ifndef __HELPER_HPP__
 #define __HELPER_HPP__
 
+#include <istream>
+#include <ostream>
 #include <vector>
 
 #include "blocks.hpp"
+#include "inputs.hpp"
+#include "observer.hpp"
 #include "solver.hpp"
 
 namespace blocks
@@ -14,9 +18,78 @@ using InputCallback = std::function<void(double, const NodeValues&, NodeValues&)
 using TimeCallback  = std::function<bool(uint k, double& t)>;
 using History       = std::map<std::string, MatrixXd>;
 
-History run(Base& model, TimeCallback time_cb, InputCallback inputs_cb=nullptr, const NodeValues& parameters=NodeValues(), Solver stepper=nullptr);
+// the default of run(): the progress every 100 points on std::cout, left out for a model without
+//   states, whose runs are quiet
+const Observers& default_observers();
+
+// sensitivities lists parameters whose forward-mode derivatives are propagated along with the
+//   values: each recorded node v then also gets a "d(v)/d(p)" history for each of them.
+//   n_threads is passed to Schedule::set_threads(). the observers see the recorded points (the
+//   history's rows) from a thread of their own, Observers() runs quietly.
+History run(Base& model, TimeCallback time_cb, InputCallback inputs_cb=nullptr, const NodeValues& parameters=NodeValues(), Solver stepper=nullptr,
+    const Nodes& sensitivities=Nodes(), uint n_threads=1, const Observers& observers=default_observers());
+// inputs read from their sources at every solver stage rather than set once per recorded point.
+//   the sources are bound to the inputs once.
+History run(Base& model, TimeCallback time_cb, const InputSources& sources, const NodeValues& parameters=NodeValues(),
+    Solver stepper=nullptr, const Nodes& sensitivities=Nodes(), uint n_threads=1, const Observers& observers=default_observers());
 bool arange(uint k, double& t, double t_init, double t_end, double dt);
 
+// the states of all the blocks as a versioned binary blob. the state vector is part of it since
+//   run() keeps the integrators up to date at every recorded point, and the model isn't stepped
+//   past the last one, so a run restarted from a restored model at that point picks up where the
+//   checkpointed one stopped.
+void checkpoint(const Base& model, std::ostream& os);
+void restore(Base& model, std::istream& is);
+
+// one continuation of a branched run. without keep_history, its history isn't built and comes
+//   back empty, e.g. when its observers (an EnsembleStatistics' one) make do without it. it has
+//   no observers by default, since the scenarios run concurrently.
+struct Scenario
+{
+    TimeCallback  time_cb;
+    InputCallback inputs_cb{nullptr};
+    NodeValues    parameters;
+    Solver        stepper{nullptr};
+    Observers     observers;
+    bool          keep_history{true};
+};
+
+// runs each scenario on its own clone of the model, starting from the model's current state (e.g.
+//   after running or restoring a common prefix), on up to n_threads threads (0: one per core).
+//   the model itself is left untouched.
+std::vector<History> branch(const Base& model, const std::vector<Scenario>& scenarios, uint n_threads=0);
+
+// dx/dt = A*x + B*u, y = C*x + D*u around an operating point. the rows and columns follow the
+//   element-wise flattening of the states (in the model's States order), inputs and outputs.
+struct LinearModel
+{
+    MatrixXd A, B, C, D;
+    Nodes    states;
+};
+
+// central differences around (t, x0, u0). x0 overrides the current values of some of the states,
+//   u0 holds the values of all the inputs of the model, of which only the listed ones are
+//   perturbed. each perturbation only re-evaluates the blocks it reaches, and the columns are
+//   spread over up to n_threads threads (0: one per core), each on its own clone of the model.
+LinearModel linearize(const Base& model, double t, const NodeValues& x0, const NodeValues& u0, const Nodes& inputs,
+    const Nodes& outputs, const NodeValues& parameters=NodeValues(), uint n_threads=0);
+
+// the samples of a history worth plotting on a given number of pixels. minmax keeps the first,
+//   smallest, largest and last samples of each pixel's time span (so a line plot looks the same
+//   as with all the samples), lttb (largest triangle three buckets) keeps one sample per pixel
+//   that best preserves the shape, and only the first and last ones on fewer than 3 pixels.
+enum class Downsampling {minmax, lttb};
+
+// the (t, y) rows to plot column `column` of signal y over [t_begin, t_end]
+MatrixXd downsample(const MatrixXd& t, const MatrixXd& y, Eigen::Index column, uint n_pixels,
+    Downsampling method=Downsampling::minmax, double t_begin=-std::numeric_limits<double>::infinity(),
+    double t_end=std::numeric_limits<double>::infinity());
+
+// all the columns of the signals, in order, each on up to n_threads threads (0: one per core)
+std::vector<MatrixXd> downsample(const History& history, const Nodes& signals, uint n_pixels,
+    Downsampling method=Downsampling::minmax, double t_begin=-std::numeric_limits<double>::infinity(),
+    double t_end=std::numeric_limits<double>::infinity(), uint n_threads=0);
+
 }
 
 #endif // __HELPER_HPP__
@@ -0,0 +1,203 @@
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+
+#include "inputs.hpp"
+
+namespace blocks
+{
+
+TabulatedInput::TabulatedInput(std::vector<double> t, MatrixXd y) :
+    _t_data(std::move(t)), _y_data(std::move(y)), _t(_t_data.data(), _t_data.size()),
+    _y(_y_data.data(), _y_data.rows(), _y_data.cols())
+{
+    assert((not _t_data.empty()) and (std::size_t(_y_data.rows()) == _t_data.size()));
+    assert(std::is_sorted(_t_data.cbegin(), _t_data.cend()));
+}
+
+TabulatedInput::TabulatedInput(std::vector<double> t, const std::vector<double>& y) :
+    TabulatedInput(std::move(t), Map<const VectorXd>(y.data(), y.size()))
+{
+}
+
+TabulatedInput::TabulatedInput(Map<const VectorXd> t, Map<const MatrixXd> y, std::shared_ptr<const void> owner) :
+    _owner(std::move(owner)), _t(t), _y(y)
+{
+    assert((_t.size() > 0) and (_y.rows() == _t.size()));
+    assert(std::is_sorted(_t.data(), _t.data() + _t.size()));
+}
+
+void TabulatedInput::value(double t, Value& v)
+{
+    const std::size_t n = _t.size();
+    if ((n == 1) or (t <= _t[0]))
+    {
+        v = _y.row(0).transpose().array();
+        return;
+    }
+    if (t >= _t[n - 1])
+    {
+        v = _y.row(n - 1).transpose().array();
+        return;
+    }
+
+    // the times asked for mostly move forward by less than an interval
+    while (t >= _t[_k + 1])
+        _k++;
+    while (t < _t[_k])
+        _k--;
+
+    const double a = (t - _t[_k])/(_t[_k + 1] - _t[_k]);
+    v = ((1 - a)*_y.row(_k) + a*_y.row(_k + 1)).transpose().array();
+}
+
+FileInput::FileInput(const std::string& path) : _path(path)
+{
+    _rewind();
+}
+
+void FileInput::_rewind()
+{
+    _is.close();
+    _is.clear();
+    _is.open(_path);
+    if (not _is)
+    {
+        std::cout << "-- cannot open input file: " << _path << "\n";
+        assert(false);
+    }
+
+    _eof = false;
+    bool ok = _read();
+    assert(ok);
+    _t_first = _t0 = _t1;
+    _y0 = _y1;
+    _read();
+}
+
+// shifts the next row in as (_t1, _y1)
+bool FileInput::_read()
+{
+    std::string line;
+    std::vector<double> row;
+    while (row.empty() and std::getline(_is, line))
+    {
+        line.erase(std::min(line.find('#'), line.size()));
+        std::replace(line.begin(), line.end(), ',', ' ');
+
+        const char* p = line.c_str();
+        char* end;
+        for (double x = std::strtod(p, &end); end != p; x = std::strtod(p, &end))
+        {
+            row.push_back(x);
+            p = end;
+        }
+    }
+
+    if (row.empty())
+    {
+        _eof = true;
+        return false;
+    }
+    assert(row.size() >= 2);
+
+    _t0 = _t1;
+    _y0.swap(_y1);
+    _t1 = row.front();
+    _y1 = Map<const ArrayXd>(row.data() + 1, row.size() - 1);
+    return true;
+}
+
+void FileInput::value(double t, Value& v)
+{
+    if ((t < _t0) and (_t0 > _t_first))
+        _rewind();
+    while ((not _eof) and (t > _t1))
+        _read();
+
+    if (t <= _t0)
+        v = _y0;
+    else if (t >= _t1)
+        v = _y1;
+    else
+    {
+        const double a = (t - _t0)/(_t1 - _t0);
+        v = (1 - a)*_y0 + a*_y1;
+    }
+}
+
+void BusInput::add(const std::string& field, std::shared_ptr<InputSource> source)
+{
+    assert(source);
+    for (const auto& f: _fields)
+    {
+        if (f.first == field)
+        {
+            std::cout << "-- duplicate bus field: " << field << "\n";
+            assert(false);
+        }
+    }
+    _fields.emplace_back(field, std::move(source));
+    _values.emplace_back();
+}
+
+const std::shared_ptr<InputSource>& BusInput::field(const std::string& name) const
+{
+    for (const auto& f: _fields)
+        if (f.first == name)
+            return f.second;
+    std::cout << "-- unknown bus field: " << name << "\n";
+    assert(false);
+    return _fields.front().second;
+}
+
+bool BusInput::find(const std::string& field, Eigen::Index& offset, Eigen::Index& size) const
+{
+    // a nested bus spans the fields named after it, which are next to each other
+    const auto prefix = field + ".";
+    bool found = false, done = false;
+    Eigen::Index base = 0;
+    for (std::size_t k = 0; k < _fields.size(); k++)
+    {
+        const auto& name = _fields[k].first;
+        const auto n = _values[k].size();
+        if ((name == field) or (name.compare(0, prefix.size(), prefix) == 0))
+        {
+            if (done)
+            {
+                std::cout << "-- bus fields not next to each other: " << field << "\n";
+                assert(false);
+            }
+            if (not found)
+            {
+                offset = base;
+                size = 0;
+                found = true;
+            }
+            size += n;
+        }
+        else if (found)
+            done = true;
+        base += n;
+    }
+    return found;
+}
+
+void BusInput::value(double t, Value& v)
+{
+    Eigen::Index n = 0;
+    for (std::size_t k = 0; k < _fields.size(); k++)
+    {
+        _fields[k].second->value(t, _values[k]);
+        n += _values[k].size();
+    }
+    v.resize(n);
+    n = 0;
+    for (const auto& value: _values)
+    {
+        v.segment(n, value.size()) = value;
+        n += value.size();
+    }
+}
+
+}
@@ -0,0 +1,130 @@
+#ifndef __INPUTS_HPP__
+#define __INPUTS_HPP__
+
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "blocks.hpp"
+
+namespace blocks
+{
+
+// where the value of an input of a model comes from. a source is asked for its value at every
+//   time the model is evaluated, solver stages included, mostly but not always in increasing
+//   order (e.g. when a step is retried). a source is used by one run at a time.
+class InputSource
+{
+public:
+    virtual ~InputSource() = default;
+
+    // writes the value at t into v, which it may resize
+    virtual void value(double t, Value& v) = 0;
+};
+
+using InputSources = std::vector<std::pair<Node, std::shared_ptr<InputSource>>>;
+
+class ConstantInput : public InputSource
+{
+protected:
+    Value _value;
+
+public:
+    ConstantInput(const Value& value) : _value(value) {}
+
+    void value(double /*t*/, Value& v) override {v = _value;}
+};
+
+// linear interpolation between the samples (t[k], y.row(k)), held beyond the first and last ones.
+//   the samples are its own, or views into memory that owner keeps alive (e.g. a mapped file).
+class TabulatedInput : public InputSource
+{
+protected:
+    std::vector<double>         _t_data;  // the samples, when its own
+    MatrixXd                    _y_data;
+    std::shared_ptr<const void> _owner;   // of the samples, when viewed
+    Map<const VectorXd>         _t;
+    Map<const MatrixXd>         _y;
+    std::size_t                 _k{0};    // the last interval used, where the next lookup starts
+
+public:
+    TabulatedInput(std::vector<double> t, MatrixXd y);
+    TabulatedInput(std::vector<double> t, const std::vector<double>& y);
+    TabulatedInput(Map<const VectorXd> t, Map<const MatrixXd> y, std::shared_ptr<const void> owner);
+
+    // the views would outlive the samples of a copy
+    TabulatedInput(const TabulatedInput&) = delete;
+    TabulatedInput& operator=(const TabulatedInput&) = delete;
+
+    const Map<const VectorXd>& t() const {return _t;}
+
+    void value(double t, Value& v) override;
+};
+
+class CallableInput : public InputSource
+{
+public:
+    using Function = std::function<Value(double)>;
+
+protected:
+    Function _func;
+
+public:
+    CallableInput(Function func) : _func(func) {}
+
+    void value(double t, Value& v) override {v = _func(t);}
+};
+
+// streams a text file of "t y0 y1 ..." rows (separated by spaces or commas, '#' starts a comment)
+//   in increasing t, keeping only the two rows around the last t asked for. interpolates like
+//   TabulatedInput. going back before these rows reads the file again from its start.
+class FileInput : public InputSource
+{
+protected:
+    std::string   _path;
+    std::ifstream _is;
+    bool          _eof;
+    double        _t_first;
+    double        _t0, _t1;
+    Value         _y0, _y1;
+
+    void _rewind();
+    bool _read();
+
+public:
+    FileInput(const std::string& path);
+
+    void value(double t, Value& v) override;
+};
+
+// the fields' values stacked in order, as by a Bus block whose fields are the sources. the fields
+//   are named like those of nested buses ("a.b" for field b of a bus in field a), and a
+//   BusSelector reading the input picks them by these names, once the input has been read. the
+//   fields of a nested bus are to be added one after the other.
+class BusInput : public InputSource
+{
+public:
+    using Fields = std::vector<std::pair<std::string, std::shared_ptr<InputSource>>>;
+
+protected:
+    Fields             _fields;
+    std::vector<Value> _values;  // the last ones, of each field
+
+public:
+    void add(const std::string& field, std::shared_ptr<InputSource> source);
+
+    const Fields& fields() const {return _fields;}
+    const std::shared_ptr<InputSource>& field(const std::string& name) const;
+
+    // the offset and size in the bus of a field, or of a nested bus, with the last values read
+    bool find(const std::string& field, Eigen::Index& offset, Eigen::Index& size) const;
+
+    void value(double t, Value& v) override;
+};
+
+}
+
+#endif // __INPUTS_HPP__
@@ -0,0 +1,361 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if __has_include(<zlib.h>)
+#include <zlib.h>
+#define MAT_FILE_ZLIB
+#endif
+
+#include "mat_file.hpp"
+
+namespace blocks
+{
+
+namespace
+{
+
+// the data types of the elements and the classes of the arrays
+enum : std::uint32_t
+{
+    miINT8 = 1, miUINT8 = 2, miINT16 = 3, miUINT16 = 4, miINT32 = 5, miUINT32 = 6, miSINGLE = 7, miDOUBLE = 9,
+    miINT64 = 12, miUINT64 = 13, miMATRIX = 14, miCOMPRESSED = 15,
+};
+enum : std::uint32_t {mxDOUBLE_CLASS = 6, mxUINT64_CLASS = 15};
+constexpr std::uint32_t COMPLEX_FLAG = 0x800;
+
+[[noreturn]] void malformed(const std::string& path, const std::string& reason)
+{
+    throw std::runtime_error("malformed MAT file: " + path + ": " + reason);
+}
+
+using Bytes = const unsigned char*;
+
+template<typename T>
+T read(Bytes p, bool swap)
+{
+    unsigned char b[sizeof(T)];
+    std::memcpy(b, p, sizeof(T));
+    if (swap)
+        std::reverse(b, b + sizeof(T));
+    T ret;
+    std::memcpy(&ret, b, sizeof(T));
+    return ret;
+}
+
+// a data element: its type, and its data in [begin, end)
+struct Element
+{
+    std::uint32_t type;
+    Bytes         begin, end;
+};
+
+// the elements of [p, end), in order
+class Elements
+{
+protected:
+    const std::string& _path;
+    Bytes              _p, _end;
+    bool               _swap;
+
+public:
+    Elements(const std::string& path, Bytes begin, Bytes end, bool swap) :
+        _path(path), _p(begin), _end(end), _swap(swap) {}
+
+    bool next(Element& element)
+    {
+        if (_p == _end)
+            return false;
+        if (_end - _p < 8)
+            malformed(_path, "truncated tag");
+
+        // in the small format, the size and the type share 4 bytes, and the data fills the other 4
+        const auto first = read<std::uint32_t>(_p, _swap);
+        if (first >> 16)
+        {
+            element = {first & 0xffff, _p + 4, _p + 4 + (first >> 16)};
+            if (element.end > _p + 8)
+                malformed(_path, "oversized small element");
+            _p += 8;
+            return true;
+        }
+
+        const std::size_t n = read<std::uint32_t>(_p + 4, _swap);
+        if (std::size_t(_end - _p - 8) < n)
+            malformed(_path, "truncated element");
+        element = {first, _p + 8, _p + 8 + n};
+        // compressed elements aren't padded to 8 bytes
+        const std::size_t padded = (first == miCOMPRESSED) ? n : (n + 7)/8*8;
+        _p += 8 + std::min(padded, std::size_t(_end - _p - 8));
+        return true;
+    }
+
+    // the next element, of the given type and with at least min_size bytes
+    Element expect(std::uint32_t type, const char* what, std::size_t min_size=0)
+    {
+        Element element{0, _end, _end};
+        if ((not next(element)) or (element.type != type) or (std::size_t(element.end - element.begin) < min_size))
+            malformed(_path, std::string("expected ") + what);
+        return element;
+    }
+};
+
+template<typename T>
+void convert(Bytes p, std::size_t n, bool swap, double* values)
+{
+    for (std::size_t k = 0; k < n; k++)
+        values[k] = double(read<T>(p + k*sizeof(T), swap));
+}
+
+std::size_t type_size(std::uint32_t type)
+{
+    switch (type)
+    {
+        case miINT8: case miUINT8: return 1;
+        case miINT16: case miUINT16: return 2;
+        case miINT32: case miUINT32: case miSINGLE: return 4;
+        case miDOUBLE: case miINT64: case miUINT64: return 8;
+        default: return 0;
+    }
+}
+
+// the values of a real numeric array, which MATLAB may store in a smaller type than its class
+//   (e.g. integer doubles as miUINT8)
+std::shared_ptr<std::vector<double>> values(const std::string& path, const Element& real, std::size_t n, bool swap)
+{
+    auto ret = std::make_shared<std::vector<double>>(n);
+    auto* v = ret->data();
+    switch (real.type)
+    {
+        case miINT8: convert<std::int8_t>(real.begin, n, swap, v); break;
+        case miUINT8: convert<std::uint8_t>(real.begin, n, swap, v); break;
+        case miINT16: convert<std::int16_t>(real.begin, n, swap, v); break;
+        case miUINT16: convert<std::uint16_t>(real.begin, n, swap, v); break;
+        case miINT32: convert<std::int32_t>(real.begin, n, swap, v); break;
+        case miUINT32: convert<std::uint32_t>(real.begin, n, swap, v); break;
+        case miSINGLE: convert<float>(real.begin, n, swap, v); break;
+        case miDOUBLE: convert<double>(real.begin, n, swap, v); break;
+        case miINT64: convert<std::int64_t>(real.begin, n, swap, v); break;
+        case miUINT64: convert<std::uint64_t>(real.begin, n, swap, v); break;
+        default: malformed(path, "unknown data type " + std::to_string(real.type));
+    }
+    return ret;
+}
+
+#ifdef MAT_FILE_ZLIB
+std::shared_ptr<std::vector<unsigned char>> inflate(const std::string& path, const Element& element)
+{
+    auto ret = std::make_shared<std::vector<unsigned char>>();
+    ret->resize(std::max<std::size_t>(4*(element.end - element.begin), 4096));
+
+    z_stream stream{};
+    stream.next_in = const_cast<unsigned char*>(element.begin);
+    stream.avail_in = uInt(element.end - element.begin);
+    if (inflateInit(&stream) != Z_OK)
+        malformed(path, "cannot inflate");
+    int status = Z_OK;
+    while (status == Z_OK)
+    {
+        if (stream.total_out == ret->size())
+            ret->resize(2*ret->size());
+        stream.next_out = ret->data() + stream.total_out;
+        stream.avail_out = uInt(ret->size() - stream.total_out);
+        status = ::inflate(&stream, Z_NO_FLUSH);
+    }
+    inflateEnd(&stream);
+    if (status != Z_STREAM_END)
+        malformed(path, "corrupt compressed element");
+    ret->resize(stream.total_out);
+    return ret;
+}
+#endif
+
+}
+
+MatFile::MatFile(const std::string& path) : _path(path)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("cannot open MAT file: " + path);
+    struct stat st;
+    if ((::fstat(fd, &st) != 0) or (st.st_size < 128))
+    {
+        ::close(fd);
+        malformed(path, "no header");
+    }
+    const std::size_t size = st.st_size;
+    void* address = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (address == MAP_FAILED)
+        throw std::runtime_error("cannot map MAT file: " + path);
+    std::shared_ptr<const void> mapping(address, [size](const void* p) {::munmap(const_cast<void*>(p), size);});
+    const auto begin = static_cast<Bytes>(address);
+
+    // "IM" as written on the machine that wrote the file
+    bool swap = false;
+    if ((begin[126] == 'M') and (begin[127] == 'I'))
+        swap = true;
+    else if ((begin[126] != 'I') or (begin[127] != 'M'))
+        malformed(path, "not a level 5 MAT file");
+    if (read<std::uint16_t>(begin + 124, swap) != 0x0100)
+        malformed(path, "version " + std::to_string(read<std::uint16_t>(begin + 124, swap)) +
+            " (v7.3 files are HDF5) isn't supported");
+
+    // an array of the elements of a miMATRIX element, whose bytes are kept alive by owner
+    auto parse = [&](const Element& matrix, const std::shared_ptr<const void>& owner, bool mapped) -> void
+    {
+        Elements elements(_path, matrix.begin, matrix.end, swap);
+        const auto flags = read<std::uint32_t>(elements.expect(miUINT32, "array flags", 4).begin, swap);
+        const auto dimensions = elements.expect(miINT32, "dimensions");
+        const auto name = elements.expect(miINT8, "array name");
+        const auto type = flags & 0xff;
+        if ((type < mxDOUBLE_CLASS) or (type > mxUINT64_CLASS) or (flags & COMPLEX_FLAG))
+            return;
+
+        Eigen::Index rows = 0, cols = 1;
+        for (auto p = dimensions.begin; p + 4 <= dimensions.end; p += 4)
+        {
+            const auto d = read<std::int32_t>(p, swap);
+            if (d < 0)
+                malformed(_path, "negative dimension");
+            if (p == dimensions.begin)
+                rows = d;
+            else
+                cols *= d;
+        }
+        const std::size_t n = rows*cols;
+        Element real{0, matrix.end, matrix.end};
+        if ((not elements.next(real)) or (type_size(real.type) == 0) or (std::size_t(real.end - real.begin) != n*type_size(real.type)))
+            malformed(_path, "unexpected real part");
+
+        const std::string key(reinterpret_cast<const char*>(name.begin), name.end - name.begin);
+        if ((real.type == miDOUBLE) and (not swap) and (reinterpret_cast<std::uintptr_t>(real.begin) % alignof(double) == 0))
+            _arrays.insert_or_assign(key, MatArray(owner, reinterpret_cast<const double*>(real.begin), rows, cols, mapped));
+        else
+        {
+            auto v = values(_path, real, n, swap);
+            const double* data = v->data();
+            _arrays.insert_or_assign(key, MatArray(std::move(v), data, rows, cols, false));
+        }
+    };
+
+    Elements elements(_path, begin + 128, begin + size, swap);
+    Element element;
+    while (elements.next(element))
+    {
+        if (element.type == miMATRIX)
+            parse(element, mapping, true);
+        else if (element.type == miCOMPRESSED)
+        {
+#ifdef MAT_FILE_ZLIB
+            auto inflated = inflate(_path, element);
+            Elements inner(_path, inflated->data(), inflated->data() + inflated->size(), swap);
+            Element matrix;
+            if (inner.next(matrix) and (matrix.type == miMATRIX))
+                parse(matrix, inflated, false);
+#else
+            throw std::runtime_error("compressed MAT file, built without zlib: " + _path);
+#endif
+        }
+    }
+}
+
+std::vector<std::string> MatFile::names() const
+{
+    std::vector<std::string> ret;
+    for (const auto& [name, array]: _arrays)
+        ret.push_back(name);
+    return ret;
+}
+
+const MatArray& MatFile::at(const std::string& name) const
+{
+    auto it = _arrays.find(name);
+    if (it == _arrays.end())
+        throw std::out_of_range("no real numeric array " + name + " in MAT file: " + _path);
+    return it->second;
+}
+
+std::shared_ptr<InputSource> table_input(const MatArray& data)
+{
+    const auto n = data.rows();
+    if ((n == 0) or (data.cols() < 2))
+        throw std::invalid_argument("a table needs rows of a time and values");
+    if (not std::is_sorted(data.data(), data.data() + n))
+        throw std::invalid_argument("the times of a table are not sorted");
+    if (n == 1)
+        return std::make_shared<ConstantInput>(data.matrix().row(0).tail(data.cols() - 1).transpose().array());
+    return std::make_shared<TabulatedInput>(Map<const VectorXd>(data.data(), n),
+        Map<const MatrixXd>(data.data() + n, n, data.cols() - 1), data.owner());
+}
+
+std::shared_ptr<BusInput> load_mat_files_as_bus(const std::string& root, const std::string& prefix, uint n_threads)
+{
+    const std::string head = prefix + ".", tail = ".mat";
+    std::vector<std::pair<std::string, std::string>> files;  // field, filename
+    for (const auto& entry: std::filesystem::directory_iterator(root))
+    {
+        const auto filename = entry.path().filename().string();
+        if (filename == prefix + tail)
+            files.emplace_back(prefix, filename);
+        else if ((filename.size() > head.size() + tail.size()) and (filename.compare(0, head.size(), head) == 0) and
+            (filename.compare(filename.size() - tail.size(), tail.size(), tail) == 0))
+            files.emplace_back(filename.substr(head.size(), filename.size() - head.size() - tail.size()), filename);
+    }
+    // the fields of a nested bus come one after the other
+    std::sort(files.begin(), files.end());
+
+    // mostly inflating, one file per thread
+    if (n_threads == 0)
+        n_threads = std::max(1u, std::thread::hardware_concurrency());
+    n_threads = std::max<std::size_t>(std::min<std::size_t>(n_threads, files.size()), 1);
+
+    // the first error of a file stops the others, and is thrown again by the calling thread
+    std::vector<std::shared_ptr<InputSource>> sources(files.size());
+    std::atomic<std::size_t> next{0};
+    std::mutex mutex;
+    std::exception_ptr error;
+    auto worker = [&]() -> void
+    {
+        for (std::size_t k = next++; k < files.size(); k = next++)
+        {
+            try
+            {
+                sources[k] = table_input(MatFile(root + "/" + files[k].second).at("data"));
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (not error)
+                    error = std::current_exception();
+                next = files.size();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (uint k = 1; k < n_threads; k++)
+        threads.emplace_back(worker);
+    worker();
+    for (auto& thread: threads)
+        thread.join();
+    if (error)
+        std::rethrow_exception(error);
+
+    auto ret = std::make_shared<BusInput>();
+    for (std::size_t k = 0; k < files.size(); k++)
+        ret->add(files[k].first, sources[k]);
+    return ret;
+}
+
+}
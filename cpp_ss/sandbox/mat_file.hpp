@@ -0,0 +1,75 @@
+#ifndef __MAT_FILE_HPP__
+#define __MAT_FILE_HPP__
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "blocks.hpp"
+#include "inputs.hpp"
+
+namespace blocks
+{
+
+// a real numeric array of a MAT file as doubles, column-major, its dimensions after the first
+//   folded into the columns. the values are kept alive by owner, e.g. the file's mapping.
+class MatArray
+{
+protected:
+    std::shared_ptr<const void> _owner;
+    const double*               _data;
+    Eigen::Index                _rows, _cols;
+    bool                        _view;
+
+public:
+    MatArray(std::shared_ptr<const void> owner, const double* data, Eigen::Index rows, Eigen::Index cols, bool view) :
+        _owner(std::move(owner)), _data(data), _rows(rows), _cols(cols), _view(view) {}
+
+    Eigen::Index rows() const {return _rows;}
+    Eigen::Index cols() const {return _cols;}
+    const double* data() const {return _data;}
+    const std::shared_ptr<const void>& owner() const {return _owner;}
+    Map<const MatrixXd> matrix() const {return Map<const MatrixXd>(_data, _rows, _cols);}
+
+    // whether the values are read straight from the mapped file, rather than from a copy
+    bool is_view() const {return _view;}
+};
+
+// the real numeric arrays of a level 5 MAT file, which is mapped into memory. an uncompressed
+//   array of doubles in the byte order of the machine is a view into the mapping. other numeric
+//   types and byte orders are converted to doubles, and compressed arrays (the default of MATLAB
+//   since v7) are inflated, if built with zlib. other arrays (complex, sparse, chars, cells,
+//   structs) are skipped. a file that can't be read or is malformed throws std::runtime_error,
+//   and so does a compressed one without zlib.
+class MatFile
+{
+protected:
+    std::string                     _path;
+    std::map<std::string, MatArray> _arrays;
+
+public:
+    MatFile(const std::string& path);
+
+    const std::string& path() const {return _path;}
+    std::vector<std::string> names() const;
+    bool contains(const std::string& name) const {return _arrays.find(name) != _arrays.end();}
+    // throws std::out_of_range if there is no such array
+    const MatArray& at(const std::string& name) const;
+};
+
+// a lookup table of the rows (t, y0, y1, ...) of data, viewing its values, or the constant
+//   (y0, y1, ...) of a single row. throws std::invalid_argument if the times are missing or
+//   unsorted.
+std::shared_ptr<InputSource> table_input(const MatArray& data);
+
+// the "data" arrays of the files "<prefix>.<field>.mat" of a directory, as the fields of a bus
+//   input (e.g. kinematics.accelLocal.trailer.x.mat is field "accelLocal.trailer.x" of
+//   load_mat_files_as_bus(root, "kinematics")), each one a table_input(). a file "<prefix>.mat"
+//   is field <prefix>. the fields are in the order of their names. the files are read on up to
+//   n_threads threads (0: one per core), and the first error of any of them is thrown.
+std::shared_ptr<BusInput> load_mat_files_as_bus(const std::string& root, const std::string& prefix, uint n_threads=0);
+
+}
+
+#endif // __MAT_FILE_HPP__
@@ -0,0 +1,574 @@
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string_view>
+
+#include "blocks.hpp"
+#include "model_file.hpp"
+#include "serialize.hpp"
+
+namespace blocks
+{
+
+namespace
+{
+
+using Substitutions = std::map<std::string, Node>;
+using Definitions   = std::map<std::string, const BlockSpec*>;
+
+void malformed(std::size_t line, const std::string& reason)
+{
+    std::cout << "-- malformed model file: line " << line << ": " << reason << "\n";
+    assert(false);
+}
+
+std::string_view trim(std::string_view s)
+{
+    while ((not s.empty()) and std::isspace(static_cast<unsigned char>(s.front())))
+        s.remove_prefix(1);
+    while ((not s.empty()) and std::isspace(static_cast<unsigned char>(s.back())))
+        s.remove_suffix(1);
+    return s;
+}
+
+std::string unquote(std::string_view s)
+{
+    std::string ret;
+    ret.reserve(s.size());
+    for (auto c: s)
+        if (c != '"')
+            ret.push_back(c);
+    return ret;
+}
+
+// whitespace-separated tokens, up to a comment. quotes protect spaces and '#'.
+void tokenize(std::string_view line, std::vector<std::string_view>& tokens)
+{
+    tokens.clear();
+    std::size_t k = 0;
+    while (true)
+    {
+        while ((k < line.size()) and std::isspace(static_cast<unsigned char>(line[k])))
+            k++;
+        if ((k == line.size()) or (line[k] == '#'))
+            return;
+
+        auto first = k;
+        bool quoted = false;
+        while ((k < line.size()) and (quoted or not std::isspace(static_cast<unsigned char>(line[k]))))
+        {
+            if (line[k] == '"')
+                quoted = not quoted;
+            k++;
+        }
+        tokens.push_back(line.substr(first, k - first));
+    }
+}
+
+// comma-separated numbers
+Value parse_value(std::string_view s, std::size_t line)
+{
+    std::vector<double> values;
+    std::string number;
+    while (true)
+    {
+        auto comma = s.find(',');
+        number = trim(s.substr(0, comma));
+        char* end;
+        values.push_back(std::strtod(number.c_str(), &end));
+        if (number.empty() or (*end != 0))
+            malformed(line, "not a number: " + number);
+        if (comma == std::string_view::npos)
+            break;
+        s.remove_prefix(comma + 1);
+    }
+
+    Value ret(values.size());
+    for (std::size_t k = 0; k < values.size(); k++)
+        ret[k] = values[k];
+    return ret;
+}
+
+SampleTime parse_sample_time(const std::string& s)
+{
+    if (s == "continuous")
+        return SampleTime::continuous();
+    if (s == "constant")
+        return SampleTime::constant();
+    if (s == "inherited")
+        return SampleTime::inherited();
+
+    // discrete:period[:offset]
+    assert(s.compare(0, 9, "discrete:") == 0);
+    auto v = parse_value(std::string_view(s).substr(9), 0);
+    assert((v.size() == 1) or (v.size() == 2));
+    return SampleTime::discrete(v[0], v.size() == 2 ? v[1] : 0.0);
+}
+
+ModelSpec parse_model_lines(std::istream& is)
+{
+    ModelSpec spec;
+
+    // the blocks whose components are being read
+    std::vector<BlockSpec*> stack{&spec.root};
+    bool in_parameters = false;
+
+    // a line at a time, the tokens viewing it
+    std::string text;
+    std::vector<std::string_view> tokens;
+    std::size_t n = 0;
+    while (std::getline(is, text))
+    {
+        std::string_view line(text);
+        n++;
+
+        tokenize(line, tokens);
+        if (tokens.empty())
+            continue;
+
+        if (tokens[0] == "end")
+        {
+            if (in_parameters)
+                in_parameters = false;
+            else if (stack.size() > 1)
+                stack.pop_back();
+            else
+                malformed(n, "unexpected end");
+        }
+        else if (in_parameters)
+        {
+            // name = value
+            line = line.substr(0, line.find('#'));
+            auto eq = line.find('=');
+            if (eq == std::string_view::npos)
+                malformed(n, "expected name = value");
+            spec.parameters.insert_or_assign(Node(unquote(trim(line.substr(0, eq)))), parse_value(line.substr(eq + 1), n));
+        }
+        else if (tokens[0] == "parameters")
+        {
+            if (stack.size() > 1)
+                malformed(n, "parameters inside a block");
+            in_parameters = true;
+        }
+        else
+        {
+            if (tokens.size() < 2)
+                malformed(n, "expected <type> <name> key=value...");
+
+            BlockSpec block;
+            block.type = tokens[0];
+            block.name = unquote(tokens[1]);
+            block.args.reserve(tokens.size() - 2);
+            for (std::size_t k = 2; k < tokens.size(); k++)
+            {
+                auto eq = tokens[k].find('=');
+                if (eq == std::string_view::npos)
+                    malformed(n, "expected key=value: " + std::string(tokens[k]));
+                block.args.emplace_back(tokens[k].substr(0, eq), unquote(tokens[k].substr(eq + 1)));
+            }
+
+            // the stack only holds ancestors, which are not moved while their last component is read
+            if (block.type == "define")
+            {
+                if (stack.size() > 1)
+                    malformed(n, "define inside a block");
+                spec.definitions.push_back(std::move(block));
+                stack.push_back(&spec.definitions.back());
+            }
+            else
+            {
+                auto& parent = *stack.back();
+                parent.components.push_back(std::move(block));
+                if (parent.components.back().type == "submodel")
+                    stack.push_back(&parent.components.back());
+            }
+        }
+    }
+
+    if (in_parameters or (stack.size() > 1))
+        malformed(n, "missing end");
+
+    return spec;
+}
+
+void write_spec(std::ostream& os, const BlockSpec& spec)
+{
+    write_binary(os, spec.type);
+    write_binary(os, spec.name);
+    write_binary(os, std::uint64_t(spec.args.size()));
+    for (const auto& [key, value]: spec.args)
+    {
+        write_binary(os, key);
+        write_binary(os, value);
+    }
+    write_binary(os, std::uint64_t(spec.components.size()));
+    for (const auto& component: spec.components)
+        write_spec(os, component);
+}
+
+void read_spec(std::istream& is, BlockSpec& spec)
+{
+    read_binary(is, spec.type);
+    read_binary(is, spec.name);
+    std::uint64_t n;
+    if (not read_count(is, n, sizeof(spec.args.front())))
+        return;
+    spec.args.resize(n);
+    for (auto& [key, value]: spec.args)
+    {
+        read_binary(is, key);
+        read_binary(is, value);
+    }
+    if (not read_count(is, n, sizeof(BlockSpec)))
+        return;
+    spec.components.resize(n);
+    for (auto& component: spec.components)
+        if (is)
+            read_spec(is, component);
+}
+
+std::map<std::string, BlockFactory::Maker>& makers()
+{
+    static std::map<std::string, BlockFactory::Maker> makers =
+    {
+        {"Bus", [](const BlockArgs& a) -> Base*
+            {
+                return new Bus(a.name().c_str(), a.nodes("iports", Nodes({Node()})), a.node("oport"));
+            }},
+        {"BusSelector", [](const BlockArgs& a) -> Base*
+            {
+                // the names of bus signals are not nodes, so they are not substituted. they default
+                //   to the oports.
+                std::vector<std::string> signals;
+                std::string_view s(a.string("signals"));
+                for (auto comma = s.find(','); not s.empty(); comma = s.find(','))
+                {
+                    signals.emplace_back(s.substr(0, comma));
+                    if (comma == std::string_view::npos)
+                        break;
+                    s.remove_prefix(comma + 1);
+                }
+                return new BusSelector(a.name().c_str(), a.node("iport"), signals, a.nodes("oports"));
+            }},
+        {"InitialValue", [](const BlockArgs& a) -> Base*
+            {
+                return new InitialValue(a.name().c_str(), a.node("iport"), a.node("oport"));
+            }},
+        {"Const", [](const BlockArgs& a) -> Base*
+            {
+                return new Const(a.name().c_str(), a.value("value"), a.nodes("oport", Nodes({Node()})));
+            }},
+        {"Gain", [](const BlockArgs& a) -> Base*
+            {
+                return new Gain(a.name().c_str(), a.number("k"), a.nodes("iport", Nodes({Node()})), a.nodes("oport", Nodes({Node()})));
+            }},
+        {"Sin", [](const BlockArgs& a) -> Base*
+            {
+                return new Sin(a.name().c_str(), a.nodes("iport", Nodes({Node()})), a.nodes("oport", Nodes({Node()})));
+            }},
+        {"Function", [](const BlockArgs& a) -> Base*
+            {
+                return new Function(a.name().c_str(), BlockFactory::function(a.string("func")), a.node("iport"), a.node("oport"),
+                    a.has("zc") ? BlockFactory::zc_function(a.string("zc")) : nullptr);
+            }},
+        {"AddSub", [](const BlockArgs& a) -> Base*
+            {
+                return new AddSub(a.name().c_str(), a.string("operators").c_str(), a.nodes("iports"), a.node("oport"), a.number("initial", 0.0));
+            }},
+        {"MulDiv", [](const BlockArgs& a) -> Base*
+            {
+                return new MulDiv(a.name().c_str(), a.string("operators").c_str(), a.nodes("iports"), a.node("oport"), a.number("initial", 1.0));
+            }},
+        {"Integrator", [](const BlockArgs& a) -> Base*
+            {
+                return new Integrator(a.name().c_str(), a.node("iport"), a.node("oport"), a.value("ic", Value(0.0)));
+            }},
+        {"Delay", [](const BlockArgs& a) -> Base*
+            {
+                return new Delay(a.name().c_str(), a.nodes("iports"), a.nodes("oport", Nodes({Node()})), a.number("lifespan", 10.0));
+            }},
+        {"Memory", [](const BlockArgs& a) -> Base*
+            {
+                return new Memory(a.name().c_str(), a.node("iport"), a.node("oport"), a.value("ic", Value::Zero(1)));
+            }},
+        {"Derivative", [](const BlockArgs& a) -> Base*
+            {
+                return new Derivative(a.name().c_str(), a.node("iport"), a.node("oport"), a.value("y0", Value::Zero(1)));
+            }},
+    };
+    return makers;
+}
+
+std::map<std::string, ActFunction>& act_functions()
+{
+    static std::map<std::string, ActFunction> functions;
+    return functions;
+}
+
+std::map<std::string, ZCFunction>& zc_functions()
+{
+    static std::map<std::string, ZCFunction> functions;
+    return functions;
+}
+
+void build(const BlockSpec& spec, const Substitutions& substitutions, const Definitions& definitions)
+{
+    BlockArgs args(spec, substitutions);
+    Base* block;
+
+    auto definition = definitions.find(spec.type);
+    if ((spec.type == "submodel") or (definition != definitions.end()))
+    {
+        auto* submodel = new Submodel(spec.name.c_str(), args.nodes("iports"), args.nodes("oports"));
+
+        // the body of a definition only sees its formal ports, bound to the actual ones like the
+        //   constructor arguments of a C++ submodel class
+        Substitutions bound;
+        const BlockSpec* body = &spec;
+        if (definition != definitions.end())
+        {
+            body = definition->second;
+            const Substitutions none;
+            BlockArgs formal(*body, none);
+            auto bind = [&](const Nodes& formals, const Nodes& actuals) -> void
+            {
+                assert(formals.size() == actuals.size());
+                for (std::size_t k = 0; k < formals.size(); k++)
+                    bound.insert_or_assign(formals[k], actuals[k]);
+            };
+            bind(formal.nodes("iports"), submodel->iports());
+            bind(formal.nodes("oports"), submodel->oports());
+        }
+
+        submodel->enter();
+        for (const auto& component: body->components)
+            build(component, body == &spec ? substitutions : bound, definitions);
+        submodel->exit();
+        block = submodel;
+    }
+    else
+        block = BlockFactory::make(spec.type, args);
+
+    if (args.has("sample_time"))
+        block->set_sample_time(parse_sample_time(args.string("sample_time")));
+}
+
+}
+
+const std::string* BlockSpec::arg(const std::string& key) const
+{
+    for (const auto& [k, v]: args)
+        if (k == key)
+            return &v;
+    return nullptr;
+}
+
+Node BlockArgs::node(const std::string& key) const
+{
+    auto nodes = this->nodes(key, Nodes({Node()}));
+    assert(nodes.size() == 1);
+    return nodes.front();
+}
+
+Nodes BlockArgs::nodes(const std::string& key, const Nodes& fallback) const
+{
+    // iport and iports are the same argument, oport and oports too
+    const std::string* raw = _spec.arg(key);
+    if (not raw)
+        raw = _spec.arg(key.back() == 's' ? key.substr(0, key.size() - 1) : key + "s");
+    if (not raw)
+        return fallback;
+
+    Nodes ret;
+    std::string_view s(*raw);
+    while (true)
+    {
+        auto comma = s.find(',');
+        std::string name(s.substr(0, comma));
+        auto it = _substitutions.find(name);
+        if (it == _substitutions.end())
+            ret.emplace_back(std::move(name));
+        else
+            ret.push_back(it->second);
+        if (comma == std::string_view::npos)
+            break;
+        s.remove_prefix(comma + 1);
+    }
+    return ret;
+}
+
+double BlockArgs::number(const std::string& key, double fallback) const
+{
+    auto v = value(key, Value(fallback));
+    assert(v.size() == 1);
+    return v[0];
+}
+
+Value BlockArgs::value(const std::string& key, const Value& fallback) const
+{
+    const auto* raw = _spec.arg(key);
+    return raw ? parse_value(*raw, 0) : fallback;
+}
+
+std::string BlockArgs::string(const std::string& key, const std::string& fallback) const
+{
+    const auto* raw = _spec.arg(key);
+    return raw ? *raw : fallback;
+}
+
+void BlockFactory::add(const std::string& type, Maker maker)
+{
+    makers().insert_or_assign(type, maker);
+}
+
+void BlockFactory::add_function(const std::string& name, ActFunction act_func)
+{
+    act_functions().insert_or_assign(name, act_func);
+}
+
+void BlockFactory::add_zc_function(const std::string& name, ZCFunction zc_func)
+{
+    zc_functions().insert_or_assign(name, zc_func);
+}
+
+Base* BlockFactory::make(const std::string& type, const BlockArgs& args)
+{
+    auto it = makers().find(type);
+    if (it == makers().end())
+    {
+        std::cout << "-- unknown block type: " << type << "\n";
+        assert(false);
+    }
+    return it->second(args);
+}
+
+const ActFunction& BlockFactory::function(const std::string& name)
+{
+    auto it = act_functions().find(name);
+    assert(it != act_functions().end());
+    return it->second;
+}
+
+const ZCFunction& BlockFactory::zc_function(const std::string& name)
+{
+    auto it = zc_functions().find(name);
+    assert(it != zc_functions().end());
+    return it->second;
+}
+
+ModelSpec parse_model(std::istream& is)
+{
+    return parse_model_lines(is);
+}
+
+static constexpr char MODEL_MAGIC[] = "SSMD";
+static constexpr std::uint32_t MODEL_VERSION = 1;
+
+void write_compiled_model(const ModelSpec& spec, std::uint64_t hash, std::ostream& os)
+{
+    os.write(MODEL_MAGIC, 4);
+    write_binary(os, MODEL_VERSION);
+    write_binary(os, hash);
+
+    write_spec(os, spec.root);
+    write_binary(os, std::uint64_t(spec.definitions.size()));
+    for (const auto& definition: spec.definitions)
+        write_spec(os, definition);
+
+    write_binary(os, std::uint64_t(spec.parameters.first.size()));
+    auto value = spec.parameters.second.begin();
+    for (const auto& parameter: spec.parameters.first)
+    {
+        write_binary(os, static_cast<const std::string&>(parameter));
+        write_binary(os, *(value++));
+    }
+}
+
+bool read_compiled_model(std::istream& is, std::uint64_t hash, ModelSpec& spec)
+{
+    char magic[4];
+    std::uint32_t version;
+    std::uint64_t h;
+    is.read(magic, 4);
+    read_binary(is, version);
+    read_binary(is, h);
+    if ((not is) or (not std::equal(magic, magic + 4, MODEL_MAGIC)) or (version != MODEL_VERSION) or (h != hash))
+        return false;
+
+    read_spec(is, spec.root);
+    std::uint64_t n;
+    if (not read_count(is, n, sizeof(BlockSpec)))
+        return false;
+    spec.definitions.resize(n);
+    for (auto& definition: spec.definitions)
+        if (is)
+            read_spec(is, definition);
+
+    if (not read_count(is, n, sizeof(Node) + sizeof(Value)))
+        return false;
+    spec.parameters.first.resize(n);
+    spec.parameters.second.resize(n);
+    auto value = spec.parameters.second.begin();
+    for (auto& parameter: spec.parameters.first)
+    {
+        if (not is)
+            return false;
+        std::string name;
+        read_binary(is, name);
+        parameter = name;
+        read_binary(is, *(value++));
+    }
+    return bool(is);
+}
+
+ModelSpec load_model_spec(const std::string& path, const std::string& cache_path)
+{
+    std::ifstream is(path, std::ios::binary);
+    if (not is)
+    {
+        std::cout << "-- can't open the model file: " << path << "\n";
+        assert(false);
+    }
+
+    // the hash of the text, read in pieces
+    std::uint64_t hash = fnv1a("");
+    char buffer[1 << 16];
+    while (is.read(buffer, sizeof(buffer)) or is.gcount())
+        hash = fnv1a(std::string_view(buffer, is.gcount()), hash);
+
+    if (not cache_path.empty())
+    {
+        ModelSpec spec;
+        std::ifstream cache(cache_path, std::ios::binary);
+        if (cache and read_compiled_model(cache, hash, spec))
+            return spec;
+    }
+
+    is.clear();
+    is.seekg(0);
+    auto spec = parse_model_lines(is);
+    // written aside and then renamed, so that a concurrent loader never reads half of it
+    if (not cache_path.empty())
+        write_file_aside(cache_path, [&](std::ostream& os) {write_compiled_model(spec, hash, os);});
+    return spec;
+}
+
+std::unique_ptr<Submodel> build_model(const ModelSpec& spec)
+{
+    // the root must not become a component of another submodel, which would own it too
+    assert(Submodel::current() == nullptr);
+
+    Definitions definitions;
+    for (const auto& definition: spec.definitions)
+        definitions.emplace(definition.name, &definition);
+
+    std::unique_ptr<Submodel> root(new Submodel(""));
+    root->enter();
+    for (const auto& component: spec.root.components)
+        build(component, Substitutions(), definitions);
+    root->exit();
+    return root;
+}
+
+}
@@ -0,0 +1,112 @@
+#ifndef __MODEL_FILE_HPP__
+#define __MODEL_FILE_HPP__
+
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "blocks.hpp"
+
+namespace blocks
+{
+
+// a text description of a model. one statement per line, '#' starts a comment:
+//
+//   parameters                              # the parameters, as name = value
+//       tractor_wheelbase = 3.0
+//       gains = 1, 2, 3                     # a vector value
+//   end
+//
+//   define PT iports=y_in,tau,y0 oports=y_out   # a reusable submodel with formal ports
+//       AddSub +-1 operators=+- iports=y_in,y_out oport=001
+//       Integrator Int iport=002 oport=-1
+//   end
+//
+//   submodel Steering iports=u oports=y     # a submodel, its blocks are its components
+//       PT PT iports=-2,008,-2 oports=y     # an instance of a definition
+//       Gain K k=-1 iport=y oport=-y_neg sample_time=discrete:0.1
+//   end
+//
+// a block is "<type> <name> key=value...". names with spaces are quoted. ports are given by
+//   iport(s)=/oport(s)= as comma-separated nodes and follow the node naming rules of the C++
+//   models. the top-level blocks are the components of an unnamed root submodel.
+class BlockSpec
+{
+public:
+    std::string type;
+    std::string name;
+    std::vector<std::pair<std::string, std::string>> args;  // key, raw value
+    std::vector<BlockSpec> components;                       // of a submodel or a definition
+
+    const std::string* arg(const std::string& key) const;
+};
+
+class ModelSpec
+{
+public:
+    BlockSpec              root;
+    std::vector<BlockSpec> definitions;
+    NodeValues             parameters;
+};
+
+// the arguments of a block being built, with the formal ports of the enclosing definitions
+//   replaced by the actual ones
+class BlockArgs
+{
+protected:
+    const BlockSpec&                   _spec;
+    const std::map<std::string, Node>& _substitutions;
+
+public:
+    BlockArgs(const BlockSpec& spec, const std::map<std::string, Node>& substitutions) :
+        _spec(spec), _substitutions(substitutions) {}
+
+    const std::string& name() const {return _spec.name;}
+    bool has(const std::string& key) const {return _spec.arg(key) != nullptr;}
+
+    // iport/iports and oport/oports are interchangeable
+    Node  node(const std::string& key) const;
+    Nodes nodes(const std::string& key, const Nodes& fallback=Nodes()) const;
+    double number(const std::string& key, double fallback=0.0) const;
+    Value value(const std::string& key, const Value& fallback=Value()) const;
+    std::string string(const std::string& key, const std::string& fallback="") const;
+};
+
+// makes the blocks of a type. the built-in blocks are registered, the others (e.g. C++ submodel
+//   classes) can be added. Function blocks refer to act/zc functions registered by name.
+class BlockFactory
+{
+public:
+    using Maker = std::function<Base*(const BlockArgs&)>;
+
+    static void add(const std::string& type, Maker maker);
+    static void add_function(const std::string& name, ActFunction act_func);
+    static void add_zc_function(const std::string& name, ZCFunction zc_func);
+
+    static Base* make(const std::string& type, const BlockArgs& args);
+    static const ActFunction& function(const std::string& name);
+    static const ZCFunction& zc_function(const std::string& name);
+};
+
+ModelSpec parse_model(std::istream& is);
+
+// the precompiled binary form, tagged with a hash of the text it was parsed from
+void write_compiled_model(const ModelSpec& spec, std::uint64_t hash, std::ostream& os);
+bool read_compiled_model(std::istream& is, std::uint64_t hash, ModelSpec& spec);
+
+// parses a model file, or reads its precompiled form from cache_path if it was compiled from the
+//   same text, (re)writing it otherwise. no cache if cache_path is empty.
+ModelSpec load_model_spec(const std::string& path, const std::string& cache_path="");
+
+// instantiates the blocks under a new root submodel, which owns them
+std::unique_ptr<Submodel> build_model(const ModelSpec& spec);
+
+}
+
+#endif // __MODEL_FILE_HPP__
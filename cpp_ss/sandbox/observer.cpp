@@ -0,0 +1,472 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <numeric>
+
+#include "observer.hpp"
+
+namespace blocks
+{
+
+static Nodes element_names(const Nodes& names, const std::vector<Eigen::Index>& sizes)
+{
+    Nodes ret;
+    for (std::size_t k = 0; k < names.size(); k++)
+    {
+        if (sizes[k] == 1)
+            ret.push_back(names[k]);
+        else
+            for (Eigen::Index e = 0; e < sizes[k]; e++)
+                ret.push_back(names[k] + "[" + std::to_string(e) + "]");
+    }
+    return ret;
+}
+
+void ProgressObserver::observe(uint k, double t, const RecordValues& /*values*/)
+{
+    if (_every and (k%_every == 0))
+        _os << k << ": " << t << "\n";
+}
+
+void CsvObserver::start(const Nodes& names, const std::vector<Eigen::Index>& sizes)
+{
+    _os.open(_path);
+    if (not _os)
+    {
+        std::cout << "-- cannot open output file: " << _path << "\n";
+        assert(false);
+    }
+
+    _os << "t";
+    for (const auto& name: element_names(names, sizes))
+        _os << "," << name;
+    _os << "\n";
+    _os.precision(17);
+}
+
+void CsvObserver::observe(uint /*k*/, double t, const RecordValues& values)
+{
+    _os << t;
+    for (Eigen::Index e = 0; e < values.size(); e++)
+        _os << "," << values[e];
+    _os << "\n";
+}
+
+void StatisticsObserver::start(const Nodes& names, const std::vector<Eigen::Index>& sizes)
+{
+    _names = element_names(names, sizes);
+    _n = 0;
+    _min = VectorXd::Constant(_names.size(), std::numeric_limits<double>::infinity());
+    _max = -_min;
+    _mean = VectorXd::Zero(_names.size());
+}
+
+void StatisticsObserver::observe(uint /*k*/, double /*t*/, const RecordValues& values)
+{
+    _n++;
+    _min = _min.cwiseMin(values);
+    _max = _max.cwiseMax(values);
+    _mean += (values - _mean)/_n;
+}
+
+void QuantileSketch::_compact(std::size_t level)
+{
+    if (level + 1 == _levels.size())
+        _levels.emplace_back();
+
+    // an odd one out stays where it is
+    auto& buffer = _levels[level];
+    std::sort(buffer.begin(), buffer.end());
+    const std::size_t n = buffer.size() & ~std::size_t(1);
+    for (std::size_t i = _odd ? 1 : 0; i < n; i += 2)
+        _levels[level + 1].push_back(buffer[i]);
+    _odd = not _odd;
+    buffer.erase(buffer.begin(), buffer.begin() + n);
+
+    if (_levels[level + 1].size() >= _k)
+        _compact(level + 1);
+}
+
+void QuantileSketch::add(double x)
+{
+    if (_levels.empty())
+        _levels.emplace_back();
+    _levels[0].push_back(x);
+    if (_levels[0].size() >= _k)
+        _compact(0);
+}
+
+void QuantileSketch::merge(const QuantileSketch& other)
+{
+    if (_levels.size() < other._levels.size())
+        _levels.resize(other._levels.size());
+    for (std::size_t level = 0; level < other._levels.size(); level++)
+        _levels[level].insert(_levels[level].end(), other._levels[level].cbegin(), other._levels[level].cend());
+    for (std::size_t level = 0; level < _levels.size(); level++)
+        if (_levels[level].size() >= _k)
+            _compact(level);
+}
+
+double QuantileSketch::n() const
+{
+    double ret = 0;
+    for (std::size_t level = 0; level < _levels.size(); level++)
+        ret += std::ldexp(double(_levels[level].size()), level);
+    return ret;
+}
+
+double QuantileSketch::quantile(double q) const
+{
+    std::vector<std::pair<double, double>> weighted;  // value, weight
+    for (std::size_t level = 0; level < _levels.size(); level++)
+        for (auto x: _levels[level])
+            weighted.emplace_back(x, std::ldexp(1.0, level));
+    if (weighted.empty())
+        return std::numeric_limits<double>::quiet_NaN();
+    std::sort(weighted.begin(), weighted.end());
+
+    const double rank = std::clamp(q, 0.0, 1.0)*n();
+    double cumulated = 0;
+    for (const auto& [x, weight]: weighted)
+    {
+        cumulated += weight;
+        if (cumulated >= rank)
+            return x;
+    }
+    return weighted.back().first;
+}
+
+void EnsembleStatistics::Partial::resize(std::size_t n_times, Eigen::Index n_elements, uint k)
+{
+    n.assign(n_times, 0.0);
+    mean = MatrixXd::Zero(n_times, n_elements);
+    m2 = MatrixXd::Zero(n_times, n_elements);
+    min = MatrixXd::Constant(n_times, n_elements, std::numeric_limits<double>::infinity());
+    max = -min;
+    sketches.assign(n_times*n_elements, QuantileSketch(k));
+}
+
+// Chan et al.'s pairwise update of the means and sums of squared deviations
+void EnsembleStatistics::Partial::merge(const Partial& other)
+{
+    for (std::size_t i = 0; i < n.size(); i++)
+    {
+        const double na = n[i], nb = other.n[i];
+        if (nb == 0)
+            continue;
+        const auto delta = (other.mean.row(i) - mean.row(i)).eval();
+        n[i] = na + nb;
+        mean.row(i) += delta*(nb/n[i]);
+        m2.row(i) += other.m2.row(i) + delta.cwiseProduct(delta)*(na*nb/n[i]);
+    }
+    min = min.cwiseMin(other.min);
+    max = max.cwiseMax(other.max);
+    for (std::size_t c = 0; c < sketches.size(); c++)
+        sketches[c].merge(other.sketches[c]);
+}
+
+// holds a partial for the duration of its run, and follows the run along the grid
+class EnsembleStatistics::RunObserver : public Observer
+{
+protected:
+    EnsembleStatistics&       _statistics;
+    Partial*                  _partial{nullptr};
+    std::vector<Eigen::Index> _columns;  // of the outputs' elements among the values
+    std::size_t               _i{0};     // the next time of the grid
+
+public:
+    RunObserver(EnsembleStatistics& statistics) : _statistics(statistics) {}
+
+    void start(const Nodes& names, const std::vector<Eigen::Index>& sizes) override
+    {
+        _partial = _statistics._acquire(names, sizes, _columns);
+        _i = 0;
+    }
+
+    void observe(uint /*k*/, double t, const RecordValues& values) override
+    {
+        const auto& grid = _statistics._grid;
+        const double tolerance = 1e-9*std::max(1.0, std::abs(t));
+        while ((_i < grid.size()) and (grid[_i] < t - tolerance))
+            _i++;
+        if ((_i == grid.size()) or (grid[_i] > t + tolerance))
+            return;
+
+        // Welford
+        auto& p = *_partial;
+        const double n = ++p.n[_i];
+        for (std::size_t e = 0; e < _columns.size(); e++)
+        {
+            const double x = values[_columns[e]];
+            const double delta = x - p.mean(_i, e);
+            p.mean(_i, e) += delta/n;
+            p.m2(_i, e) += delta*(x - p.mean(_i, e));
+            p.min(_i, e) = std::min(p.min(_i, e), x);
+            p.max(_i, e) = std::max(p.max(_i, e), x);
+            p.sketches[_i*_columns.size() + e].add(x);
+        }
+        _i++;
+    }
+
+    void finish() override
+    {
+        _statistics._release(_partial);
+        _partial = nullptr;
+    }
+};
+
+EnsembleStatistics::EnsembleStatistics(std::vector<double> grid, const Nodes& outputs, uint sketch_size) :
+    _grid(std::move(grid)), _outputs(outputs), _k(sketch_size)
+{
+    assert(std::is_sorted(_grid.cbegin(), _grid.cend()));
+}
+
+std::shared_ptr<Observer> EnsembleStatistics::observer()
+{
+    return std::make_shared<RunObserver>(*this);
+}
+
+EnsembleStatistics::Partial* EnsembleStatistics::_acquire(const Nodes& names, const std::vector<Eigen::Index>& sizes,
+    std::vector<Eigen::Index>& columns)
+{
+    std::vector<Eigen::Index> offsets(names.size() + 1, 0);
+    std::partial_sum(sizes.cbegin(), sizes.cend(), offsets.begin() + 1);
+
+    std::vector<Eigen::Index> output_sizes;
+    columns.clear();
+    for (const auto& output: _outputs)
+    {
+        auto k = std::distance(names.cbegin(), std::find(names.cbegin(), names.cend(), output));
+        if (std::size_t(k) == names.size())
+        {
+            std::cout << "-- not recorded: " << output << "\n";
+            assert(false);
+        }
+        output_sizes.push_back(sizes[k]);
+        for (Eigen::Index e = 0; e < sizes[k]; e++)
+            columns.push_back(offsets[k] + e);
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_sizes.empty())
+    {
+        _sizes = output_sizes;
+        _offsets.assign(1, 0);
+        for (auto size: _sizes)
+            _offsets.push_back(_offsets.back() + size);
+    }
+    assert(_sizes == output_sizes);
+    _total.reset();
+
+    if (_free.empty())
+    {
+        _partials.push_back(std::make_unique<Partial>());
+        _partials.back()->resize(_grid.size(), columns.size(), _k);
+        _free.push_back(_partials.back().get());
+    }
+    auto* ret = _free.back();
+    _free.pop_back();
+    return ret;
+}
+
+void EnsembleStatistics::_release(Partial* partial)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _free.push_back(partial);
+}
+
+// read once the runs are over
+const EnsembleStatistics::Partial& EnsembleStatistics::_merged(const Node& output, Eigen::Index& offset,
+    Eigen::Index& size)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    assert(_free.size() == _partials.size());
+
+    auto k = std::distance(_outputs.cbegin(), std::find(_outputs.cbegin(), _outputs.cend(), output));
+    assert(std::size_t(k) < _outputs.size());
+    assert(not _sizes.empty());
+    offset = _offsets[k];
+    size = _sizes[k];
+
+    if (not _total)
+    {
+        _total = std::make_unique<Partial>();
+        _total->resize(_grid.size(), _offsets.back(), _k);
+        for (const auto& partial: _partials)
+            _total->merge(*partial);
+    }
+    return *_total;
+}
+
+std::vector<double> EnsembleStatistics::counts()
+{
+    if (_outputs.empty() or _sizes.empty())
+        return std::vector<double>(_grid.size(), 0.0);
+    Eigen::Index offset, size;
+    return _merged(_outputs.front(), offset, size).n;
+}
+
+MatrixXd EnsembleStatistics::mean(const Node& output)
+{
+    Eigen::Index offset, size;
+    const auto& total = _merged(output, offset, size);
+    return total.mean.middleCols(offset, size);
+}
+
+MatrixXd EnsembleStatistics::variance(const Node& output)
+{
+    Eigen::Index offset, size;
+    const auto& total = _merged(output, offset, size);
+    MatrixXd ret = total.m2.middleCols(offset, size);
+    for (std::size_t i = 0; i < _grid.size(); i++)
+        ret.row(i) /= (total.n[i] > 1) ? total.n[i] - 1 : std::numeric_limits<double>::quiet_NaN();
+    return ret;
+}
+
+MatrixXd EnsembleStatistics::min(const Node& output)
+{
+    Eigen::Index offset, size;
+    return _merged(output, offset, size).min.middleCols(offset, size);
+}
+
+MatrixXd EnsembleStatistics::max(const Node& output)
+{
+    Eigen::Index offset, size;
+    return _merged(output, offset, size).max.middleCols(offset, size);
+}
+
+MatrixXd EnsembleStatistics::quantile(const Node& output, double q)
+{
+    Eigen::Index offset, size;
+    const auto& total = _merged(output, offset, size);
+    const auto n_elements = _offsets.back();
+    MatrixXd ret(_grid.size(), size);
+    for (std::size_t i = 0; i < _grid.size(); i++)
+        for (Eigen::Index e = 0; e < size; e++)
+            ret(i, e) = total.sketches[i*n_elements + offset + e].quantile(q);
+    return ret;
+}
+
+ObserverPipeline::ObserverPipeline(const Observers& observers, const Nodes& names,
+    const std::vector<Eigen::Index>& sizes, std::size_t capacity, std::size_t max_spilled) :
+    _observers(observers), _capacity(capacity), _max_spilled(max_spilled)
+{
+    assert(names.size() == sizes.size());
+
+    _width = 2 + std::accumulate(sizes.cbegin(), sizes.cend(), Eigen::Index(0));
+    if (_capacity == 0)
+        _capacity = std::max<std::size_t>(256, (std::size_t(1) << 20)/(sizeof(double)*_width));
+    _ring.resize(_width*_capacity);
+    _consumer = std::thread(&ObserverPipeline::_consume, this, names, sizes);
+}
+
+void ObserverPipeline::_flush_spilled()
+{
+    while ((_n_spilled > 0) and (not _full()))
+    {
+        const auto head = _head.load(std::memory_order_relaxed);
+        const double* slot = _spilled.front().data() + _spilled_begin*_width;
+        std::copy(slot, slot + _width, _ring.begin() + (head%_capacity)*_width);
+        _head.store(head + 1, std::memory_order_release);
+
+        // an emptied block is kept for the next spill
+        _n_spilled--;
+        if ((++_spilled_begin == _capacity) or (_n_spilled == 0))
+        {
+            _spare = std::move(_spilled.front());
+            _spilled.pop_front();
+            _spilled_begin = 0;
+        }
+    }
+}
+
+double* ObserverPipeline::record(uint k, double t)
+{
+    // in the ring if no spilled point waits for it, else at the end of the spill
+    double* slot;
+    while (true)
+    {
+        _flush_spilled();
+        _in_ring = (_n_spilled == 0) and (not _full());
+        if (_in_ring)
+        {
+            slot = _ring.data() + (_head.load(std::memory_order_relaxed)%_capacity)*_width;
+            break;
+        }
+
+        const auto end = _spilled_begin + _n_spilled;
+        if ((end < _spilled.size()*_capacity) or (_spilled.size() < _max_spilled))
+        {
+            if (end == _spilled.size()*_capacity)
+            {
+                if (_spare.empty())
+                    _spare.resize(_width*_capacity);
+                _spilled.push_back(std::move(_spare));
+                _spare = std::vector<double>();
+            }
+            slot = _spilled.back().data() + (end%_capacity)*_width;
+            _n_spilled++;
+            break;
+        }
+
+        // the spill is full: wait for the observers
+        std::this_thread::yield();
+    }
+
+    slot[0] = k;
+    slot[1] = t;
+    return slot + 2;
+}
+
+void ObserverPipeline::commit()
+{
+    if (_in_ring)
+        _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    _in_ring = false;
+}
+
+void ObserverPipeline::finish()
+{
+    if (not _consumer.joinable())
+        return;
+
+    while (_n_spilled > 0)
+    {
+        _flush_spilled();
+        std::this_thread::yield();
+    }
+    _done.store(true, std::memory_order_release);
+    _consumer.join();
+}
+
+void ObserverPipeline::_consume(Nodes names, std::vector<Eigen::Index> sizes)
+{
+    for (auto& observer: _observers)
+        observer->start(names, sizes);
+
+    while (true)
+    {
+        const auto tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire))
+        {
+            // the producer is done once it says so and everything it wrote has been read
+            if (_done.load(std::memory_order_acquire) and (tail == _head.load(std::memory_order_acquire)))
+                break;
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+            continue;
+        }
+
+        const double* slot = _ring.data() + (tail%_capacity)*_width;
+        const RecordValues values(slot + 2, _width - 2);
+        for (auto& observer: _observers)
+            observer->observe(uint(slot[0]), slot[1], values);
+        _tail.store(tail + 1, std::memory_order_release);
+    }
+
+    for (auto& observer: _observers)
+        observer->finish();
+}
+
+}
@@ -0,0 +1,211 @@
+#ifndef __OBSERVER_HPP__
+#define __OBSERVER_HPP__
+
+#include <atomic>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "blocks.hpp"
+
+namespace blocks
+{
+
+// the values of a recorded point, flattened in the order and with the sizes given to start()
+using RecordValues = Map<const VectorXd>;
+
+// watches the recorded points of a run. all its calls are made, in order, from a thread of the
+//   run's own, so that it may be slow (e.g. write files) without holding the simulation up.
+class Observer
+{
+public:
+    virtual ~Observer() = default;
+
+    // before the first point, with the recorded nodes and their numbers of elements
+    virtual void start(const Nodes& /*names*/, const std::vector<Eigen::Index>& /*sizes*/) {}
+    // k counts the recorded points from 0
+    virtual void observe(uint k, double t, const RecordValues& values) = 0;
+    // after the last point
+    virtual void finish() {}
+};
+
+using Observers = std::vector<std::shared_ptr<Observer>>;
+
+// "k: t" every so many points
+class ProgressObserver : public Observer
+{
+protected:
+    uint          _every;
+    std::ostream& _os;
+
+public:
+    ProgressObserver(uint every=100, std::ostream& os=std::cout) : _every(every), _os(os) {}
+
+    void observe(uint k, double t, const RecordValues& values) override;
+};
+
+// one row per point, "t" and then one column per element, e.g. "x" or "x[1]" for a vector
+class CsvObserver : public Observer
+{
+protected:
+    std::string   _path;
+    std::ofstream _os;
+
+public:
+    CsvObserver(const std::string& path) : _path(path) {}
+
+    void start(const Nodes& names, const std::vector<Eigen::Index>& sizes) override;
+    void observe(uint k, double t, const RecordValues& values) override;
+    void finish() override {_os.close();}
+};
+
+// the minimum, maximum and mean of each element over the run, read once the run is over
+class StatisticsObserver : public Observer
+{
+protected:
+    Nodes    _names;
+    uint     _n{0};
+    VectorXd _min, _max, _mean;
+
+public:
+    void start(const Nodes& names, const std::vector<Eigen::Index>& sizes) override;
+    void observe(uint k, double t, const RecordValues& values) override;
+
+    // the element names, as the columns of CsvObserver
+    const Nodes& names() const {return _names;}
+    uint n() const {return _n;}
+    const VectorXd& min() const {return _min;}
+    const VectorXd& max() const {return _max;}
+    const VectorXd& mean() const {return _mean;}
+};
+
+// an approximation of the quantiles of a stream of values in bounded memory: a stack of buffers of
+//   k values, those of level l standing for 2^l values each. a full buffer is sorted and every
+//   other value of it goes one level up. sketches of parts of a stream merge into one of it. the
+//   rank error is about 1/k.
+class QuantileSketch
+{
+protected:
+    uint                             _k;
+    std::vector<std::vector<double>> _levels;
+    bool                             _odd{false};  // which half of a buffer goes up
+
+    void _compact(std::size_t level);
+
+public:
+    QuantileSketch(uint k=64) : _k(k) {assert(k >= 2);}
+
+    void add(double x);
+    void merge(const QuantileSketch& other);
+    double n() const;
+    double quantile(double q) const;
+};
+
+// statistics of outputs over an ensemble of runs at each time of a grid they share (points off
+//   the grid, e.g. events, are skipped): the count, mean, variance, minimum, maximum and
+//   quantiles of each element, without keeping the histories. each run feeds it through an
+//   observer of its own, which updates one of a few partial aggregates, so runs on different
+//   threads don't wait for each other. the partials are merged when the results are asked for.
+class EnsembleStatistics
+{
+protected:
+    struct Partial
+    {
+        std::vector<double>         n;         // per time
+        MatrixXd                    mean, m2;  // time x element, Welford
+        MatrixXd                    min, max;
+        std::vector<QuantileSketch> sketches;  // time-major
+
+        void resize(std::size_t n_times, Eigen::Index n_elements, uint k);
+        void merge(const Partial& other);
+    };
+
+    class RunObserver;
+
+    std::vector<double>       _grid;
+    Nodes                     _outputs;
+    uint                      _k;
+    std::vector<Eigen::Index> _sizes;    // of the outputs, known once a run starts
+    std::vector<Eigen::Index> _offsets;  // of the outputs among the elements
+
+    std::mutex                            _mutex;
+    std::vector<std::unique_ptr<Partial>> _partials;  // all of them
+    std::vector<Partial*>                 _free;      // those not being updated by a run
+    std::unique_ptr<Partial>              _total;     // merged, reset by a new run
+
+    Partial* _acquire(const Nodes& names, const std::vector<Eigen::Index>& sizes, std::vector<Eigen::Index>& columns);
+    void _release(Partial* partial);
+    const Partial& _merged(const Node& output, Eigen::Index& offset, Eigen::Index& size);
+
+public:
+    EnsembleStatistics(std::vector<double> grid, const Nodes& outputs, uint sketch_size=64);
+
+    // a new observer for one run
+    std::shared_ptr<Observer> observer();
+
+    const std::vector<double>& grid() const {return _grid;}
+    // the number of runs seen at each time
+    std::vector<double> counts();
+
+    // time x element of the output
+    MatrixXd mean(const Node& output);
+    MatrixXd variance(const Node& output);  // unbiased
+    MatrixXd min(const Node& output);
+    MatrixXd max(const Node& output);
+    MatrixXd quantile(const Node& output, double q);
+};
+
+// feeds the observers from a single-producer single-consumer ring of fixed-size slots (k, t and
+//   the values) emptied by a thread of its own. the ring holds about 1 MB of slots, 256 at least,
+//   unless its capacity is given. the producer doesn't wait for slow observers: while the ring is
+//   full, its points go to spill blocks of as many slots as the ring, allocated a block at a time
+//   (a spare one is reused) and moved to the ring as it empties. once max_spilled blocks are
+//   full, the producer waits for the observers to make room, which bounds the memory used.
+class ObserverPipeline
+{
+protected:
+    Observers                       _observers;
+    std::size_t                     _width;     // of a slot
+    std::size_t                     _capacity;  // in slots, of the ring and of a spill block
+    std::size_t                     _max_spilled;  // blocks
+    std::vector<double>             _ring;
+    alignas(64) std::atomic<std::size_t> _head{0};  // the slots written so far
+    alignas(64) std::atomic<std::size_t> _tail{0};  // the slots read so far
+    std::atomic<bool>               _done{false};
+    std::deque<std::vector<double>> _spilled;   // the producer's blocks, in order after the ring
+    std::size_t                     _spilled_begin{0};  // the first slot of the first block not moved yet
+    std::size_t                     _n_spilled{0};      // slots
+    std::vector<double>             _spare;     // an emptied block
+    bool                            _in_ring{false};
+    std::thread                     _consumer;
+
+    bool _full() const {return _head.load(std::memory_order_relaxed) - _tail.load(std::memory_order_acquire) == _capacity;}
+    void _flush_spilled();
+    void _consume(Nodes names, std::vector<Eigen::Index> sizes);
+
+public:
+    ObserverPipeline(const Observers& observers, const Nodes& names, const std::vector<Eigen::Index>& sizes,
+        std::size_t capacity=0, std::size_t max_spilled=64);
+    ~ObserverPipeline() {finish();}
+
+    ObserverPipeline(const ObserverPipeline&) = delete;
+    ObserverPipeline& operator=(const ObserverPipeline&) = delete;
+
+    // where to write the values of the next point, which is passed on by commit()
+    double* record(uint k, double t);
+    // the points waiting for room in the ring
+    std::size_t n_spilled() const {return _n_spilled;}
+    void commit();
+
+    // waits for the observers to have seen all the points
+    void finish();
+};
+
+}
+
+#endif // __OBSERVER_HPP__
@@ -0,0 +1,366 @@
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <pybind11/stl.h>
+
+#include "blocks.hpp"
+#include "helper.hpp"
+#include "solver.hpp"
+
+// python bindings of the engine, with the constructor signatures of py_ss/blocks.py, so that the
+//   python models only need to import from here instead:
+//
+//     from pyss import blocks, helper, solver
+//
+// the blocks created from python are owned by their submodels, like the ones created with new in
+//   c++, and are never deleted by python.
+
+namespace py = pybind11;
+using namespace blocks;
+
+namespace
+{
+
+// a scalar or a numpy array, anything else raises a TypeError
+Value to_value(py::handle h)
+{
+    if (py::isinstance<py::float_>(h) or py::isinstance<py::int_>(h))
+        return Value(h.cast<double>());
+
+    auto a = py::array_t<double, py::array::c_style | py::array::forcecast>::ensure(h);
+    if (not a)
+        throw py::type_error("expected a number or an array of numbers, got " + py::repr(h).cast<std::string>());
+    Value ret(a.size());
+    std::copy(a.data(), a.data() + a.size(), ret.data());
+    return ret;
+}
+
+py::object from_value(const Value& v)
+{
+    if (v.size() == 1)
+        return py::float_(v[0]);
+    return py::array_t<double>(v.size(), v.data());
+}
+
+// a port is a str, an int or a Node (see N()), and ports are a port or a list of them
+Node to_node(py::handle h)
+{
+    if (py::isinstance<Node>(h))
+        return h.cast<Node>();
+    if (py::isinstance<py::int_>(h))
+        return Node(h.cast<int>());
+    if (not py::isinstance<py::str>(h))
+        throw py::type_error("expected a port (a str, an int or a N()), got " + py::repr(h).cast<std::string>());
+    return Node(h.cast<std::string>());
+}
+
+Nodes to_nodes(py::handle h)
+{
+    if (not (py::isinstance<py::list>(h) or py::isinstance<py::tuple>(h)))
+        return Nodes(to_node(h));
+
+    Nodes ret;
+    for (auto p: h)
+        ret.push_back(to_node(p));
+    return ret;
+}
+
+py::list to_list(const Nodes& nodes)
+{
+    py::list ret;
+    for (const auto& node: nodes)
+        ret.append(py::str(node));
+    return ret;
+}
+
+NodeValues to_node_values(const py::dict& d)
+{
+    NodeValues ret;
+    for (auto [k, v]: d)
+        ret.insert_or_assign(to_node(k), to_value(v));
+    return ret;
+}
+
+py::dict to_dict(const NodeValues& nv)
+{
+    py::dict ret;
+    auto value = nv.second.begin();
+    for (const auto& node: nv.first)
+        ret[py::str(node)] = from_value(*(value++));
+    return ret;
+}
+
+// the history, as numpy arrays viewing the matrices of a history owned by their common base
+py::dict to_dict(History&& history)
+{
+    auto* owner = new History(std::move(history));
+    py::capsule base(owner, [](void* p) {delete static_cast<History*>(p);});
+
+    py::dict ret;
+    for (auto& [name, m]: *owner)
+    {
+        const py::ssize_t rows = m.rows();
+        const py::ssize_t cols = m.cols();
+        const py::ssize_t s = sizeof(double);
+        // scalar signals are 1-d, like in py_ss
+        if (cols == 1)
+            ret[py::str(name)] = py::array_t<double>({rows}, {s}, m.data(), base);
+        else
+            ret[py::str(name)] = py::array_t<double>({rows, cols}, {s, s*rows}, m.data(), base);
+    }
+    return ret;
+}
+
+// python subclasses of Base implement activation_function(self, t, x) with x a list of values
+class PyBase : public Base
+{
+public:
+    using Base::Base;
+
+    NodeValues activation_function(double t, const NodeValues& x) override
+    {
+        py::gil_scoped_acquire gil;
+        py::function f = py::get_override(static_cast<const Base*>(this), "activation_function");
+        if (not f)
+            throw py::type_error(_name + ": a python block must define activation_function(self, t, x)");
+
+        py::list args;
+        for (const auto& v: x.second)
+            args.append(from_value(v));
+        Values values;
+        for (auto v: f(t, args))
+            values.push_back(to_value(v));
+        if (values.size() != _oports.size())
+            throw py::value_error(_name + ": activation_function returned " + std::to_string(values.size()) +
+                " values for " + std::to_string(_oports.size()) + " oports");
+        return NodeValues(_oports, values);
+    }
+};
+
+// a Solver is a std::function, which must not be converted to a python callable and back
+struct PySolver
+{
+    Solver solver;
+};
+
+template<typename T>
+using Block = py::class_<T, Base, std::unique_ptr<T, py::nodelete>>;
+
+}
+
+PYBIND11_MODULE(pyss, m)
+{
+    m.doc() = "the ss_modeling engine";
+
+    auto blocks_m = m.def_submodule("blocks");
+    auto solver_m = m.def_submodule("solver");
+    auto helper_m = m.def_submodule("helper");
+
+    // a Node is a global node name, that submodels don't prefix with their names
+    py::class_<Node>(blocks_m, "Node")
+        .def(py::init([](const std::string& s)
+            {
+                Node node(s);
+                node.lock();
+                return node;
+            }))
+        .def("__str__", [](const Node& node) {return std::string(node);})
+        .def("__repr__", [](const Node& node) {return "N('" + node + "')";});
+
+    blocks_m.def("N", [](py::handle h) -> py::object
+        {
+            auto lock = [](Node node) -> Node
+            {
+                node.lock();
+                return node;
+            };
+            if (py::isinstance<py::list>(h) or py::isinstance<py::tuple>(h))
+            {
+                py::list ret;
+                for (auto p: h)
+                    ret.append(lock(to_node(p)));
+                return ret;
+            }
+            return py::cast(lock(to_node(h)));
+        });
+
+    py::class_<Base, PyBase, std::unique_ptr<Base, py::nodelete>>(blocks_m, "Base")
+        .def(py::init([](const std::string& name, py::object iports, py::object oports)
+            {
+                return new PyBase(name.c_str(), to_nodes(iports), to_nodes(oports));
+            }), py::arg("name"), py::arg("iports")=py::list(), py::arg("oports")=py::list())
+        .def_property_readonly("_name", &Base::name)
+        .def_property_readonly("_iports", [](const Base& b) {return to_list(b.iports());})
+        .def_property_readonly("_oports", [](const Base& b) {return to_list(b.oports());})
+        .def("__repr__", [](const Base& b)
+            {
+                return "<" + b.name() + ", iports: " + py::str(to_list(b.iports())).cast<std::string>() +
+                    ", oports: " + py::str(to_list(b.oports())).cast<std::string>() + ">";
+            });
+
+    Block<Bus>(blocks_m, "Bus")
+        .def(py::init([](const std::string& name, py::object iports, py::object oport)
+            {
+                return new Bus(name.c_str(), to_nodes(iports), to_node(oport));
+            }), py::arg("name"), py::arg("iports")="-", py::arg("oport")="-");
+
+    Block<BusSelector>(blocks_m, "BusSelector")
+        .def(py::init([](const std::string& name, py::object iport, const std::vector<std::string>& signals, py::object oports)
+            {
+                return new BusSelector(name.c_str(), to_node(iport), signals, to_nodes(oports));
+            }), py::arg("name"), py::arg("iport")="-", py::arg("signals")=std::vector<std::string>(), py::arg("oports")=py::list());
+
+    Block<InitialValue>(blocks_m, "InitialValue")
+        .def(py::init([](const std::string& name, py::object iport, py::object oport)
+            {
+                return new InitialValue(name.c_str(), to_node(iport), to_node(oport));
+            }), py::arg("name"), py::arg("iport")="-", py::arg("oport")="-");
+
+    Block<Const>(blocks_m, "Const")
+        .def(py::init([](const std::string& name, py::object value, py::object oport)
+            {
+                return new Const(name.c_str(), to_value(value), to_nodes(oport));
+            }), py::arg("name"), py::arg("value"), py::arg("oport")="-");
+
+    Block<Gain>(blocks_m, "Gain")
+        .def(py::init([](const std::string& name, double k, py::object iport, py::object oport)
+            {
+                return new Gain(name.c_str(), k, to_nodes(iport), to_nodes(oport));
+            }), py::arg("name"), py::arg("k"), py::arg("iport")="-", py::arg("oport")="-");
+
+    Block<Sin>(blocks_m, "Sin")
+        .def(py::init([](const std::string& name, py::object iport, py::object oport)
+            {
+                return new Sin(name.c_str(), to_nodes(iport), to_nodes(oport));
+            }), py::arg("name"), py::arg("iport")="-", py::arg("oport")="-");
+
+    // act_func(t, x) is called with the gil held, x being a float or a numpy array
+    Block<Function>(blocks_m, "Function")
+        .def(py::init([](const std::string& name, py::function act_func, py::object iport, py::object oport)
+            {
+                auto f = [act_func](double t, const Value& x) -> Value
+                {
+                    py::gil_scoped_acquire gil;
+                    return to_value(act_func(t, from_value(x)));
+                };
+                return new Function(name.c_str(), f, to_node(iport), to_node(oport));
+            }), py::arg("name"), py::arg("act_func"), py::arg("iport")="-", py::arg("oport")="-");
+
+    Block<AddSub>(blocks_m, "AddSub")
+        .def(py::init([](const std::string& name, const std::string& operations, py::object iports, py::object oport, double initial)
+            {
+                return new AddSub(name.c_str(), operations.c_str(), to_nodes(iports), to_node(oport), initial);
+            }), py::arg("name"), py::arg("operations"), py::arg("iports"), py::arg("oport")="-", py::arg("initial")=0.0);
+
+    Block<MulDiv>(blocks_m, "MulDiv")
+        .def(py::init([](const std::string& name, const std::string& operations, py::object iports, py::object oport, double initial)
+            {
+                return new MulDiv(name.c_str(), operations.c_str(), to_nodes(iports), to_node(oport), initial);
+            }), py::arg("name"), py::arg("operations"), py::arg("iports"), py::arg("oport")="-", py::arg("initial")=1.0);
+
+    Block<Integrator>(blocks_m, "Integrator")
+        .def(py::init([](const std::string& name, py::object iport, py::object oport, py::object x0)
+            {
+                return new Integrator(name.c_str(), to_node(iport), to_node(oport), to_value(x0));
+            }), py::arg("name"), py::arg("iport")="-", py::arg("oport")="-", py::arg("x0")=0.0);
+
+    Block<Delay>(blocks_m, "Delay")
+        .def(py::init([](const std::string& name, py::object iports, py::object oport, double lifespan)
+            {
+                return new Delay(name.c_str(), to_nodes(iports), to_nodes(oport), lifespan);
+            }), py::arg("name"), py::arg("iports"), py::arg("oport")="-", py::arg("lifespan")=10.0);
+
+    Block<Memory>(blocks_m, "Memory")
+        .def(py::init([](const std::string& name, py::object iport, py::object oport, py::object ic)
+            {
+                return new Memory(name.c_str(), to_node(iport), to_node(oport), to_value(ic));
+            }), py::arg("name"), py::arg("iport")="-", py::arg("oport")="-", py::arg("ic")=0.0);
+
+    Block<Derivative>(blocks_m, "Derivative")
+        .def(py::init([](const std::string& name, py::object iport, py::object oport, py::object y0)
+            {
+                return new Derivative(name.c_str(), to_node(iport), to_node(oport), to_value(y0));
+            }), py::arg("name"), py::arg("iport")="-", py::arg("oport")="-", py::arg("y0")=0.0);
+
+    // blocks created inside "with submodel:" are its components
+    Block<Submodel>(blocks_m, "Submodel")
+        .def(py::init([](const std::string& name, py::object iports, py::object oports)
+            {
+                return new Submodel(name.c_str(), to_nodes(iports), to_nodes(oports));
+            }), py::arg("name"), py::arg("iports")=py::list(), py::arg("oports")=py::list())
+        .def("__enter__", [](py::object self)
+            {
+                self.cast<Submodel&>().enter();
+                return self;
+            })
+        .def("__exit__", [](Submodel& self, py::object, py::object, py::object)
+            {
+                self.exit();
+                return false;
+            });
+
+    // the instances of python subclasses carry the overrides of PyBase, so they must live as long
+    //   as their (never deleted) blocks. this is set up after the c++ subclasses are bound.
+    blocks_m.attr("_python_blocks") = py::list();
+    py::exec(R"(
+def _init_subclass(cls, **kwargs):
+    init = cls.__init__
+    def __init__(self, *args, **kw):
+        init(self, *args, **kw)
+        _python_blocks.append(self)
+    cls.__init__ = __init__
+Base.__init_subclass__ = classmethod(_init_subclass)
+del _init_subclass
+)", blocks_m.attr("__dict__"));
+
+    // the solvers are opaque: they are only passed back to run()
+    py::class_<PySolver>(solver_m, "Solver");
+    solver_m.attr("rk4") = PySolver{rk4};
+    solver_m.attr("simple") = PySolver{simple};
+    solver_m.def("adams_bashforth_moulton", [](uint order, double restart_tolerance) {
+        return PySolver{AdamsBashforthMoulton(order, restart_tolerance)};
+    }, py::arg("order")=4, py::arg("restart_tolerance")=1e-4);
+    solver_m.def("symplectic", [](Base& model, const std::string& method) {
+        if ((method != "verlet") and (method != "yoshida"))
+            throw py::value_error("method must be 'verlet' or 'yoshida', not '" + method + "'");
+        return PySolver{Symplectic(model, method == "verlet" ? Symplectic::Method::verlet : Symplectic::Method::yoshida)};
+    }, py::arg("model"), py::arg("method")="verlet");
+
+    // inputs_cb(t, x) returns a dict of input values, x being a dict of the states. the
+    //   simulation itself runs without the gil.
+    helper_m.def("run", [](Base& model, std::vector<double> T, py::object inputs_cb, py::dict parameters,
+        const PySolver& stepper)
+        {
+            TimeCallback time_cb = [T](uint k, double& t) -> bool
+            {
+                if (k >= T.size())
+                    return false;
+                t = T[k];
+                return true;
+            };
+
+            // run() copies the callback without the gil, hence the handle instead of an object
+            InputCallback cb = nullptr;
+            if (not inputs_cb.is_none())
+            {
+                cb = [f = py::handle(inputs_cb)](double t, const NodeValues& x, NodeValues& inputs) -> void
+                {
+                    py::gil_scoped_acquire gil;
+                    inputs.join(to_node_values(py::dict(f(t, to_dict(x)))));
+                };
+            }
+
+            auto p = to_node_values(parameters);
+            History history;
+            {
+                py::gil_scoped_release nogil;
+                history = run(model, time_cb, cb, p, stepper.solver);
+            }
+            return to_dict(std::move(history));
+        }, py::arg("model"), py::arg("T"), py::arg("inputs_cb")=py::none(), py::arg("parameters")=py::dict(),
+        py::arg("stepper")=PySolver{rk4});
+}
@@ -0,0 +1,1234 @@
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <mutex>
+#include <numeric>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <typeinfo>
+
+#include "blocks.hpp"
+#include "schedule.hpp"
+
+namespace blocks
+{
+
+// runs a DAG of groups on a fixed set of threads, the calling one included. a thread runs the
+//   groups it made ready first, and steals the oldest ones of the others when it has none.
+class TaskPool
+{
+protected:
+    struct Queue
+    {
+        std::mutex       mutex;
+        std::deque<uint> groups;
+    };
+
+    std::vector<std::thread> _threads;
+    std::vector<Queue>       _queues;  // one per thread, 0 is the caller's
+
+    std::mutex              _mutex;
+    std::condition_variable _wake;
+    uint                    _generation{0};
+    bool                    _stop{false};
+
+    // the current job, set before _remaining
+    const std::vector<std::vector<uint>>* _successors{nullptr};
+    const std::function<void(uint)>*      _run_group{nullptr};
+    std::unique_ptr<std::atomic<uint>[]>  _pending;
+    std::size_t                           _capacity{0};
+    std::atomic<std::size_t>              _remaining{0};
+
+    void _push(uint self, uint group)
+    {
+        std::lock_guard<std::mutex> lock(_queues[self].mutex);
+        _queues[self].groups.push_back(group);
+    }
+
+    bool _pop(uint self, uint& group)
+    {
+        for (std::size_t n = 0; n < _queues.size(); n++)
+        {
+            auto& queue = _queues[(self + n)%_queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.groups.empty())
+                continue;
+            if (n == 0)
+            {
+                group = queue.groups.back();
+                queue.groups.pop_back();
+            }
+            else
+            {
+                group = queue.groups.front();
+                queue.groups.pop_front();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void _work(uint self)
+    {
+        uint group;
+        while (_remaining.load(std::memory_order_acquire) > 0)
+        {
+            if (not _pop(self, group))
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            (*_run_group)(group);
+            for (auto successor: (*_successors)[group])
+                if (_pending[successor].fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    _push(self, successor);
+            _remaining.fetch_sub(1, std::memory_order_acq_rel);
+        }
+    }
+
+public:
+    TaskPool(uint n_threads) : _queues(n_threads)
+    {
+        for (uint self = 1; self < n_threads; self++)
+            _threads.emplace_back([this, self]()
+                {
+                    uint generation = 0;
+                    while (true)
+                    {
+                        {
+                            std::unique_lock<std::mutex> lock(_mutex);
+                            _wake.wait(lock, [&]() {return _stop or (_generation != generation);});
+                            if (_stop)
+                                return;
+                            generation = _generation;
+                        }
+                        _work(self);
+                    }
+                });
+    }
+
+    ~TaskPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _wake.notify_all();
+        for (auto& thread: _threads)
+            thread.join();
+    }
+
+    uint n_threads() const {return _queues.size();}
+
+    void run(const std::vector<std::vector<uint>>& successors, const std::vector<uint>& n_predecessors,
+        const std::function<void(uint)>& run_group)
+    {
+        const auto n = n_predecessors.size();
+        if (_capacity < n)
+        {
+            _pending.reset(new std::atomic<uint>[n]);
+            _capacity = n;
+        }
+        for (std::size_t k = 0; k < n; k++)
+            _pending[k].store(n_predecessors[k], std::memory_order_relaxed);
+        _successors = &successors;
+        _run_group = &run_group;
+
+        // a thread still leaving the previous job may take a group as soon as it is queued
+        _remaining.store(n, std::memory_order_release);
+        uint self = 0;
+        for (std::size_t k = 0; k < n; k++)
+            if (n_predecessors[k] == 0)
+                _push((self++)%_queues.size(), k);
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _generation++;
+        }
+        _wake.notify_all();
+        _work(0);
+    }
+};
+
+static void inconsistent(const Base& block, const char* reason)
+{
+    std::cout << "-- inconsistent sample time: " << block.name() << ": " << reason << "\n";
+    assert(false);
+}
+
+// everything the order of the entries derives from, in construction order
+static std::uint64_t structure_hash(const std::vector<std::pair<Base*, SampleTime>>& blocks, const States& states,
+    const NodeValues& parameters, const Nodes& inputs)
+{
+    std::ostringstream os;
+    auto write_nodes = [&](const Nodes& nodes) -> void
+    {
+        for (const auto& node: nodes)
+            write_binary(os, static_cast<const std::string&>(node));
+        write_binary(os, std::uint64_t(nodes.size()));
+    };
+
+    for (const auto& [block, sample_time]: blocks)
+    {
+        write_binary(os, std::string(typeid(*block).name()));
+        write_binary(os, block->name());
+        write_nodes(block->iports());
+        write_nodes(block->oports());
+        write_binary(os, int(sample_time.type()));
+        write_binary(os, sample_time.period());
+        write_binary(os, sample_time.offset());
+        write_binary(os, block->has_direct_feedthrough());
+        write_binary(os, block->is_pure());
+        write_binary(os, block->has_zero_crossings());
+    }
+    write_nodes(std::get<0>(states));
+    write_nodes(std::get<2>(states));
+    write_nodes(parameters.first);
+    write_nodes(inputs);
+    return fnv1a(os.str());
+}
+
+std::string Schedule::_cache_directory;
+
+void Schedule::set_cache_directory(const std::string& directory)
+{
+    _cache_directory = directory;
+}
+
+Schedule::Schedule(Base& model, const States& states, const NodeValues& parameters, const Nodes& inputs)
+{
+    // leaf blocks in the order of construction, with the sample times they declare or inherit
+    //   from their submodels
+    std::vector<std::pair<Base*, SampleTime>> blocks;
+    std::function<void(Base&, const SampleTime&)> flatten = [&](Base& block, const SampleTime& parent) -> void
+    {
+        auto sample_time = block.sample_time();
+        if (sample_time.type() == SampleTime::Type::inherited)
+            sample_time = parent;
+
+        if (auto* submodel = dynamic_cast<Submodel*>(&block))
+        {
+            for (auto* component: submodel->components())
+                flatten(*component, sample_time);
+        }
+        else
+            blocks.emplace_back(&block, sample_time);
+    };
+    flatten(model, SampleTime::inherited());
+
+    // signals known before any block is activated
+    for (const auto& state: std::get<0>(states))
+        _states.push_back(_signal(state));
+    for (const auto& parameter: parameters.first)
+    {
+        auto k = _signal(parameter);
+        _dependencies[k] = Dependency::parameter;
+        _parameters.push_back(k);
+    }
+    for (const auto& input: inputs)
+        _signal(input);
+    std::vector<bool> known(_signals.first.size(), true);
+
+    std::vector<Entry> pending;
+    std::vector<const Base*> stateful;
+    for (auto& [block, sample_time]: blocks)
+    {
+        const auto& oports = block->oports();
+        if (std::all_of(oports.cbegin(), oports.cend(), [&](const Node& oport)
+            {
+                return std::find(_states.cbegin(), _states.cend(), _signal(oport)) != _states.cend();
+            }))
+        {
+            // e.g. Integrator: its outputs are states
+            auto type = sample_time.type();
+            if ((type != SampleTime::Type::continuous) and (type != SampleTime::Type::inherited))
+                inconsistent(*block, "continuous states require a continuous sample time");
+            stateful.push_back(block);
+            continue;
+        }
+
+        Entry entry;
+        entry.block = block;
+        if (dynamic_cast<Bus*>(block))
+            entry.kind = Kind::bus;
+        else if (dynamic_cast<BusSelector*>(block))
+            entry.kind = Kind::selector;
+        entry.dependency = Dependency::varying;
+        entry.sample_time = sample_time;
+        entry.rate = -1;
+        if (block->has_direct_feedthrough())
+        {
+            entry.args.first = block->iports();
+            for (const auto& iport: block->iports())
+                entry.iports.push_back(_signal(iport));
+        }
+        entry.args.second.resize(entry.iports.size());
+        for (const auto& oport: oports)
+            entry.oports.push_back(_signal(oport));
+        pending.push_back(std::move(entry));
+    }
+    for (const auto& state: std::get<2>(states))
+        _derivatives.push_back(_signal(state));
+    known.resize(_signals.first.size(), false);
+
+    // the order is read from the cache when the model was compiled before
+    _hash = structure_hash(blocks, states, parameters, inputs);
+    if (not _read_cache(pending))
+    {
+        std::map<const Base*, std::size_t> indices;
+        for (std::size_t k = 0; k < pending.size(); k++)
+            indices.emplace(pending[k].block, k);
+        const auto n_pending = pending.size();
+
+        _sort(pending, known, stateful);
+        _write_cache(indices, n_pending);
+    }
+
+    for (std::size_t k = _first_varying_entry; k < _entries.size(); k++)
+        if (_entries[k].block->has_zero_crossings())
+            _zc_entries.push_back(k);
+
+    // the rates of the discrete entries that are not folded
+    std::map<const Base*, int> rates;
+    for (std::size_t k = _first_varying_entry; k < _entries.size(); k++)
+    {
+        auto& entry = _entries[k];
+        if (entry.sample_time.type() != SampleTime::Type::discrete)
+            continue;
+        auto it = std::find_if(_rates.begin(), _rates.end(), [&](const Rate& rate)
+            {
+                return rate.sample_time == entry.sample_time;
+            });
+        entry.rate = std::distance(_rates.begin(), it);
+        if (it == _rates.end())
+            _rates.push_back({entry.sample_time, entry.sample_time.offset(), false});
+        rates.emplace(entry.block, entry.rate);
+    }
+    for (auto& [block, sample_time]: blocks)
+    {
+        auto it = rates.find(block);
+        _blocks.emplace_back(block, it == rates.end() ? -1 : it->second);
+    }
+
+    // the outputs of the continuous blocks without direct feedthrough are what step() stores (e.g.
+    //   a Memory's), so that the derivatives change when such a block is stepped
+    for (std::size_t k = _first_varying_entry; k < _first_output_entry; k++)
+        if ((_entries[k].rate < 0) and (not _entries[k].block->has_direct_feedthrough()))
+            _stepped_derivatives = true;
+
+    for (std::size_t k = 0; k < _entries.size(); k++)
+        if (_entries[k].kind == Kind::bus)
+            _buses.emplace(_entries[k].oports.front(), k);
+
+    // the signals of the BusSelectors, in the Bus blocks or else in bus inputs
+    for (auto& entry: _entries)
+    {
+        if (entry.kind != Kind::selector)
+            continue;
+        for (const auto& signal: static_cast<const BusSelector*>(entry.block)->signals())
+        {
+            auto field = _field(entry.iports.front(), signal);
+            if ((not field.name.empty()) and std::none_of(inputs.cbegin(), inputs.cend(), [&](const Node& input)
+                {
+                    return index(input) == field.signal;
+                }))
+            {
+                std::cout << "-- unknown bus signal: " << entry.block->name() << ": " << signal << "\n";
+                assert(false);
+            }
+            entry.fields.push_back(std::move(field));
+        }
+    }
+
+    // the zero crossings are computed from the arguments of the last activation, which an
+    //   activation in place doesn't fill
+    for (auto& entry: _entries)
+    {
+        if ((entry.kind != Kind::block) or entry.block->has_zero_crossings())
+            continue;
+        entry.in_place = true;
+        for (auto k: entry.iports)
+            entry.inputs.push_back(&_signals.second[k]);
+        for (auto k: entry.oports)
+            entry.outputs.push_back(&_signals.second[k]);
+    }
+
+    for (std::size_t k = 0; k < _first_parameter_entry; k++)
+        _activate(_entries[k], 0.0);
+    set_parameters(parameters);
+}
+
+// sorts the entries by dependency, then topologically, with the cone of the derivatives ahead of
+//   the outputs, resolving the inherited sample times
+void Schedule::_sort(std::vector<Entry>& pending, std::vector<bool>& known, const std::vector<const Base*>& stateful)
+{
+    // topological sort, preserving the order of construction among independent blocks
+    std::vector<Entry> sorted;
+    sorted.reserve(pending.size());
+    bool progress;
+    do
+    {
+        progress = false;
+        for (auto it = pending.begin(); it != pending.end();)
+        {
+            if (std::all_of(it->iports.cbegin(), it->iports.cend(), [&](uint k) {return known[k];}))
+            {
+                for (auto k: it->oports)
+                {
+                    assert(not known[k]);
+                    known[k] = true;
+                }
+                sorted.push_back(std::move(*it));
+                it = pending.erase(it);
+                progress = true;
+            }
+            else
+                it++;
+        }
+    } while (progress);
+
+    auto is_known = [&](const Node& node) -> bool
+    {
+        auto it = _indices.find(node);
+        return (it != _indices.end()) and known[it->second];
+    };
+
+    std::vector<const Base*> unprocessed;
+    for (const auto& entry: pending)
+        unprocessed.push_back(entry.block);
+    for (const auto* block: stateful)
+    {
+        for (const auto& iport: block->iports())
+            if (not is_known(iport))
+            {
+                unprocessed.push_back(block);
+                break;
+            }
+    }
+    if (unprocessed.size())
+    {
+        std::cout << "-- unprocessed blocks detected:\n";
+        for (const auto& c: unprocessed)
+        {
+            std::cout << "- " << c->name() << "\n";
+            for (const auto& p: c->iports())
+                std::cout << "  - i: " << (is_known(p) ? " " : "*") <<  p << "\n";
+            for (const auto& p: c->oports())
+                std::cout << "  - o: " << (is_known(p) ? " " : "*") <<  p << "\n";
+        }
+    }
+
+    // inherited sample times are resolved from the inputs, so in topological order. parameters
+    //   are constant, states and inputs continuous.
+    std::vector<SampleTime> sample_times(_signals.first.size(), SampleTime::continuous());
+    for (auto k: _parameters)
+        sample_times[k] = SampleTime::constant();
+    for (auto& entry: sorted)
+    {
+        auto& sample_time = entry.sample_time;
+        bool constant_inputs = std::all_of(entry.iports.cbegin(), entry.iports.cend(), [&](uint k)
+            {
+                return sample_times[k].type() == SampleTime::Type::constant;
+            });
+
+        switch (sample_time.type())
+        {
+        case SampleTime::Type::inherited:
+            if (constant_inputs)
+                sample_time = entry.block->is_pure() ? SampleTime::constant() : SampleTime::continuous();
+            else
+            {
+                // the common rate of the non-constant inputs, continuous if they differ
+                for (auto k: entry.iports)
+                {
+                    if (sample_times[k].type() == SampleTime::Type::constant)
+                        continue;
+                    if (sample_time.type() == SampleTime::Type::inherited)
+                        sample_time = sample_times[k];
+                    else if (sample_time != sample_times[k])
+                        sample_time = SampleTime::continuous();
+                }
+            }
+            break;
+        case SampleTime::Type::constant:
+            if (not constant_inputs)
+                inconsistent(*entry.block, "a constant block can only have constant or parameter inputs");
+            break;
+        case SampleTime::Type::discrete:
+            if ((sample_time.period() <= 0) or (sample_time.offset() < 0) or (sample_time.offset() >= sample_time.period()))
+                inconsistent(*entry.block, "a discrete sample time needs period > 0 and 0 <= offset < period");
+            break;
+        default:
+            break;
+        }
+
+        for (auto k: entry.oports)
+            sample_times[k] = sample_time;
+    }
+
+    // a pure or constant block is as variable as its most variable input
+    for (auto& entry: sorted)
+    {
+        if (entry.block->is_pure() or (entry.sample_time.type() == SampleTime::Type::constant))
+        {
+            entry.dependency = Dependency::constant;
+            for (auto k: entry.iports)
+                entry.dependency = std::max(entry.dependency, _dependencies[k]);
+        }
+        for (auto k: entry.oports)
+            _dependencies[k] = entry.dependency;
+    }
+
+    // an entry never depends on a more variable one, so grouping keeps the order valid
+    std::stable_sort(sorted.begin(), sorted.end(), [](const Entry& a, const Entry& b)
+        {
+            return a.dependency < b.dependency;
+        });
+    _entries = std::move(sorted);
+    auto first_of = [&](Dependency dependency) -> std::size_t
+    {
+        return std::distance(_entries.begin(), std::find_if(_entries.begin(), _entries.end(),
+            [&](const Entry& entry) {return entry.dependency >= dependency;}));
+    };
+    _first_parameter_entry = first_of(Dependency::parameter);
+    _first_varying_entry = first_of(Dependency::varying);
+
+    // backward cone of the derivatives and of the zero crossings among the varying entries
+    std::vector<bool> in_cone(_entries.size(), false);
+    std::map<uint, std::size_t> producers;
+    std::vector<uint> frontier(_derivatives);
+    for (std::size_t k = _first_varying_entry; k < _entries.size(); k++)
+    {
+        for (auto signal: _entries[k].oports)
+            producers.emplace(signal, k);
+        if (_entries[k].block->has_zero_crossings())
+            frontier.push_back(_entries[k].oports.front());
+    }
+    while (not frontier.empty())
+    {
+        auto it = producers.find(frontier.back());
+        frontier.pop_back();
+        if ((it == producers.end()) or in_cone[it->second])
+            continue;
+        in_cone[it->second] = true;
+        const auto& iports = _entries[it->second].iports;
+        frontier.insert(frontier.end(), iports.cbegin(), iports.cend());
+    }
+
+    // the cone only depends on itself, so moving it ahead of the outputs keeps the order valid
+    std::vector<Entry> outputs;
+    auto last = _entries.begin() + _first_varying_entry;
+    for (auto it = last; it != _entries.end(); it++)
+    {
+        if (in_cone[std::distance(_entries.begin(), it)])
+        {
+            if (last != it)
+                *last = std::move(*it);
+            last++;
+        }
+        else
+            outputs.push_back(std::move(*it));
+    }
+    _first_output_entry = std::distance(_entries.begin(), last);
+    std::move(outputs.begin(), outputs.end(), last);
+}
+
+static constexpr char SCHEDULE_MAGIC[] = "SSSC";
+static constexpr std::uint32_t SCHEDULE_VERSION = 1;
+
+std::string Schedule::_cache_path() const
+{
+    std::ostringstream os;
+    os << _cache_directory << "/" << std::hex << std::setw(16) << std::setfill('0') << _hash << ".schedule";
+    return os.str();
+}
+
+bool Schedule::_read_cache(std::vector<Entry>& pending)
+{
+    if (_cache_directory.empty())
+        return false;
+
+    std::ifstream is(_cache_path(), std::ios::binary);
+    char magic[4];
+    std::uint32_t version;
+    std::uint64_t hash, n_pending;
+    is.read(magic, 4);
+    read_binary(is, version);
+    read_binary(is, hash);
+    read_binary(is, n_pending);
+    if ((not is) or (not std::equal(magic, magic + 4, SCHEDULE_MAGIC)) or (version != SCHEDULE_VERSION) or
+        (hash != _hash) or (n_pending != pending.size()))
+        return false;
+
+    std::vector<std::uint64_t> order, boundaries;
+    std::vector<int> dependencies, types;
+    std::vector<double> periods, offsets;
+    read_binary(is, order);
+    read_binary(is, dependencies);
+    read_binary(is, types);
+    read_binary(is, periods);
+    read_binary(is, offsets);
+    read_binary(is, boundaries);
+
+    const auto n = order.size();
+    std::vector<bool> used(n_pending, false);
+    bool ok = is and (n <= n_pending) and (dependencies.size() == n) and (types.size() == n) and
+        (periods.size() == n) and (offsets.size() == n) and (boundaries.size() == 3) and
+        std::is_sorted(boundaries.cbegin(), boundaries.cend()) and (boundaries.back() <= n);
+    for (std::size_t k = 0; ok and (k < n); k++)
+    {
+        ok = (order[k] < n_pending) and (not used[order[k]]);
+        if (ok)
+            used[order[k]] = true;
+    }
+    if (not ok)
+        return false;
+
+    _entries.reserve(n);
+    for (std::size_t k = 0; k < n; k++)
+    {
+        auto& entry = pending[order[k]];
+        entry.dependency = Dependency(dependencies[k]);
+        entry.sample_time = SampleTime(SampleTime::Type(types[k]), periods[k], offsets[k]);
+        for (auto signal: entry.oports)
+            _dependencies[signal] = entry.dependency;
+        _entries.push_back(std::move(entry));
+    }
+    _first_parameter_entry = boundaries[0];
+    _first_varying_entry = boundaries[1];
+    _first_output_entry = boundaries[2];
+    return true;
+}
+
+void Schedule::_write_cache(const std::map<const Base*, std::size_t>& indices, std::size_t n_pending) const
+{
+    if (_cache_directory.empty())
+        return;
+
+    std::vector<std::uint64_t> order;
+    std::vector<int> dependencies, types;
+    std::vector<double> periods, offsets;
+    for (const auto& entry: _entries)
+    {
+        order.push_back(indices.at(entry.block));
+        dependencies.push_back(int(entry.dependency));
+        types.push_back(int(entry.sample_time.type()));
+        periods.push_back(entry.sample_time.period());
+        offsets.push_back(entry.sample_time.offset());
+    }
+
+    // written aside and then renamed, so that a schedule of the same model compiled meanwhile
+    //   never reads half of it
+    write_file_aside(_cache_path(), [&](std::ostream& os)
+        {
+            os.write(SCHEDULE_MAGIC, 4);
+            write_binary(os, SCHEDULE_VERSION);
+            write_binary(os, _hash);
+            write_binary(os, std::uint64_t(n_pending));
+            write_binary(os, order);
+            write_binary(os, dependencies);
+            write_binary(os, types);
+            write_binary(os, periods);
+            write_binary(os, offsets);
+            write_binary(os, std::vector<std::uint64_t>{_first_parameter_entry, _first_varying_entry, _first_output_entry});
+        });
+}
+
+uint Schedule::_signal(const Node& node)
+{
+    auto it = _indices.find(node);
+    if (it != _indices.end())
+        return it->second;
+
+    uint k = _signals.first.size();
+    _signals.first.push_back(node);
+    _signals.second.emplace_back();
+    _dependencies.push_back(Dependency::varying);
+    _indices.emplace(node, k);
+    return k;
+}
+
+// the signal picked from a bus by its name: the field of a Bus ("a.b" for field b of a bus in
+//   field a), or the bus itself with the name, if it isn't built by a Bus
+Schedule::Field Schedule::_field(uint bus, const std::string& name) const
+{
+    auto it = _buses.find(bus);
+    if (it == _buses.end())
+        return {bus, name};
+
+    const auto& entry = _entries[it->second];
+    const auto& names = static_cast<const Bus*>(entry.block)->fields();
+    for (std::size_t k = 0; k < names.size(); k++)
+    {
+        const auto& field = names[k];
+        if (name == field)
+            return {entry.iports[k], ""};
+        if ((name.size() > field.size()) and (name[field.size()] == '.') and (name.compare(0, field.size(), field) == 0))
+            return _field(entry.iports[k], name.substr(field.size() + 1));
+    }
+    return {bus, name};
+}
+
+// the offset and size of a signal of a bus input in the values its BusInput read last
+void Schedule::_find_in_source(Field& field, const Base& selector) const
+{
+    for (const auto& [k, source]: _sources)
+        if (k == field.signal)
+            if (auto input = dynamic_cast<const BusInput*>(source.get()))
+                if (input->find(field.name, field.offset, field.size))
+                    return;
+    std::cout << "-- unknown bus signal: " << selector.name() << ": " << field.name << "\n";
+    assert(false);
+}
+
+void Schedule::_activate(Entry& entry, double t)
+{
+    if (entry.kind == Kind::bus)
+    {
+        // the fields are stacked straight into the bus signal
+        Eigen::Index n = 0;
+        for (auto k: entry.iports)
+            n += _signals.second[k].size();
+        auto& bus = _signals.second[entry.oports.front()];
+        bus.resize(n);
+        n = 0;
+        for (auto k: entry.iports)
+        {
+            const auto& field = _signals.second[k];
+            bus.segment(n, field.size()) = field;
+            n += field.size();
+        }
+        return;
+    }
+
+    if (entry.kind == Kind::selector)
+    {
+        auto field = entry.fields.begin();
+        for (auto k: entry.oports)
+        {
+            if (field->name.empty())
+                _signals.second[k] = _signals.second[field->signal];
+            else
+            {
+                if (field->size < 0)
+                    _find_in_source(*field, *entry.block);
+                _signals.second[k] = _signals.second[field->signal].segment(field->offset, field->size);
+            }
+            field++;
+        }
+        return;
+    }
+
+    // the tangents are computed from the arguments too
+    if (entry.in_place and not entry.differentiated)
+    {
+        if (entry.block->activate_in_place(t, entry.inputs, entry.outputs))
+            return;
+        entry.in_place = false;
+    }
+
+    auto arg = entry.args.second.begin();
+    for (auto k: entry.iports)
+        *(arg++) = _signals.second[k];
+
+    auto output_values = entry.block->activation_function(t, entry.args);
+    assert(output_values.second.size() == entry.oports.size());
+    auto value = output_values.second.begin();
+    for (auto k: entry.oports)
+        _signals.second[k] = std::move(*(value++));
+}
+
+uint Schedule::index(const Node& node) const
+{
+    auto it = _indices.find(node);
+    assert(it != _indices.end());
+    return it->second;
+}
+
+bool Schedule::is_parameter(uint signal) const
+{
+    return std::find(_parameters.cbegin(), _parameters.cend(), signal) != _parameters.cend();
+}
+
+void Schedule::set_parameters(const NodeValues& parameters)
+{
+    auto value = parameters.second.begin();
+    for (const auto& parameter: parameters.first)
+    {
+        auto it = _indices.find(parameter);
+        assert((it != _indices.end()) and is_parameter(it->second));
+        _signals.second[it->second] = *(value++);
+    }
+
+    for (std::size_t k = _first_parameter_entry; k < _first_varying_entry; k++)
+        _activate(_entries[k], 0.0);
+    if (_n_directions)
+        _differentiate(_first_parameter_entry, _first_varying_entry, 0.0, true);
+}
+
+void Schedule::set_sensitivities(const Nodes& parameters)
+{
+    std::vector<bool> seeded(_signals.first.size(), false);
+    _n_directions = 0;
+    for (const auto& parameter: parameters)
+    {
+        auto k = index(parameter);
+        assert(is_parameter(k));
+        seeded[k] = true;
+        _n_directions += _signals.second[k].size();
+    }
+    for (auto k: _states)
+        seeded[k] = true;
+
+    _tangents.assign(_signals.first.size(), Tangent());
+    uint offset = 0;
+    for (const auto& parameter: parameters)
+    {
+        auto k = index(parameter);
+        const auto n = _signals.second[k].size();
+        _tangents[k] = Tangent::Zero(n, _n_directions);
+        _tangents[k].middleCols(offset, n).matrix().setIdentity();
+        offset += n;
+    }
+
+    // an entry is differentiated if any of its inputs depends on a seed. the blocks without
+    //   direct feedthrough (e.g. Memory) keep the tangents of their past inputs, which are
+    //   computed after them, hence the fixed point.
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+        for (std::size_t k = _first_parameter_entry; k < _entries.size(); k++)
+        {
+            auto& entry = _entries[k];
+            const auto& iports = entry.block->iports();
+            if (entry.differentiated or std::none_of(iports.cbegin(), iports.cend(), [&](const Node& node)
+                {
+                    auto it = _indices.find(node);
+                    return (it != _indices.end()) and seeded[it->second];
+                }))
+                continue;
+            entry.differentiated = changed = true;
+            entry.dargs.resize(entry.iports.size());
+            for (auto n: entry.oports)
+                seeded[n] = true;
+        }
+    }
+
+    _differentiate(_first_parameter_entry, _first_varying_entry, 0.0, true);
+}
+
+Tangent& Schedule::_tangent(uint signal)
+{
+    // signals that depend on no seed have a zero tangent
+    auto& tangent = _tangents[signal];
+    if ((tangent.rows() != _signals.second[signal].size()) or (tangent.cols() != _n_directions))
+        tangent = Tangent::Zero(_signals.second[signal].size(), _n_directions);
+    return tangent;
+}
+
+void Schedule::_differentiate(std::size_t first, std::size_t last, double t, bool major)
+{
+    for (auto k = first; k < last; k++)
+    {
+        auto& entry = _entries[k];
+        if ((not entry.differentiated) or not ((entry.rate < 0) or (major and _rates[entry.rate].hit)))
+            continue;
+
+        if (entry.kind == Kind::selector)
+        {
+            auto field = entry.fields.begin();
+            for (auto n: entry.oports)
+            {
+                const auto& tangent = _tangent(field->signal);
+                _tangents[n] = field->name.empty() ? tangent : Tangent(tangent.middleRows(field->offset, field->size));
+                field++;
+            }
+            continue;
+        }
+
+        auto darg = entry.dargs.begin();
+        for (auto n: entry.iports)
+            *(darg++) = _tangent(n);
+
+        auto tangents = entry.block->tangents(t, entry.args, entry.dargs);
+        assert(tangents.size() == entry.oports.size());
+        auto tangent = tangents.begin();
+        for (auto n: entry.oports)
+            _tangents[n] = std::move(*(tangent++));
+    }
+}
+
+void Schedule::set_inputs(const NodeValues& inputs)
+{
+    auto value = inputs.second.begin();
+    for (const auto& input: inputs.first)
+    {
+        auto it = _indices.find(input);
+        assert(it != _indices.end());
+        _signals.second[it->second] = *(value++);
+    }
+}
+
+void Schedule::set_input_source(const Node& input, std::shared_ptr<InputSource> source)
+{
+    auto k = index(input);
+    assert(_dependencies[k] == Dependency::varying);
+    _sources.emplace_back(k, source);
+
+    // the signals BusSelectors pick from the input must be in it. they are placed once it has
+    //   been read.
+    for (const auto& entry: _entries)
+    {
+        for (const auto& field: entry.fields)
+        {
+            if ((field.signal == k) and (not field.name.empty()))
+            {
+                auto found = field;
+                _find_in_source(found, *entry.block);
+            }
+        }
+    }
+}
+
+void Schedule::_read_sources(double t)
+{
+    for (auto& [k, source]: _sources)
+        source->value(t, _signals.second[k]);
+}
+
+void Schedule::_set_states(const NodeValues& x)
+{
+    assert(x.second.size() == (_n_directions ? 2 : 1)*_states.size());
+    auto value = x.second.begin();
+    for (auto k: _states)
+        _signals.second[k] = *(value++);
+
+    if (_n_directions)
+    {
+        for (auto k: _states)
+        {
+            const auto& v = *(value++);
+            _tangents[k] = Map<const Tangent>(v.data(), _signals.second[k].size(), _n_directions);
+        }
+    }
+}
+
+Schedule::~Schedule() = default;
+
+void Schedule::set_threads(uint n_threads)
+{
+    if (n_threads == 0)
+        n_threads = std::max(1u, std::thread::hardware_concurrency());
+    _n_threads = n_threads;
+    _pool.reset();
+    _plans.clear();
+}
+
+void Schedule::_evaluate(std::size_t first, std::size_t last, double t, bool major)
+{
+    // discrete blocks hold their outputs between hits
+    auto activate = [&](std::size_t k) -> void
+    {
+        auto& entry = _entries[k];
+        if ((entry.rate < 0) or (major and _rates[entry.rate].hit))
+            _activate(entry, t);
+    };
+
+    auto plan = _plans.find({first, last});
+    if ((_n_threads > 1) and (plan == _plans.end()) and (first < last))
+    {
+        // the first evaluation is sequential, and timed to plan the next ones
+        std::vector<double> costs;
+        costs.reserve(last - first);
+        for (auto k = first; k < last; k++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            activate(k);
+            costs.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        plan = _plans.emplace(std::make_pair(first, last), _plan(first, last, costs)).first;
+    }
+    else if ((plan != _plans.end()) and plan->second.parallel)
+    {
+        if (not _pool)
+            _pool = std::make_unique<TaskPool>(_n_threads);
+        const auto& groups = plan->second.groups;
+        std::function<void(uint)> run_group = [&](uint group) -> void
+        {
+            for (auto k: groups[group])
+                activate(k);
+        };
+        _pool->run(plan->second.successors, plan->second.n_predecessors, run_group);
+    }
+    else
+    {
+        for (auto k = first; k < last; k++)
+            activate(k);
+    }
+
+    if (_n_directions)
+        _differentiate(first, last, t, major);
+}
+
+Schedule::Plan Schedule::_plan(std::size_t first, std::size_t last, const std::vector<double>& costs) const
+{
+    // below these costs (in seconds), waking up threads costs more than it saves
+    constexpr double MIN_GROUP_COST = 10e-6;
+    constexpr double MIN_PARALLEL_COST = 50e-6;
+    // the work over the critical path, below which running in parallel hardly saves anything
+    constexpr double MIN_SPEEDUP = 1.3;
+
+    // an entry joins the group of its producers if they are all in one, so chains stay together
+    //   and the groups form a DAG
+    std::vector<int> producer(_signals.first.size(), -1);
+    std::vector<std::vector<std::size_t>> members;
+    std::vector<std::set<uint>> predecessors;
+    for (auto k = first; k < last; k++)
+    {
+        const auto& entry = _entries[k];
+        std::set<uint> groups;
+        for (auto n: entry.iports)
+            if (producer[n] >= 0)
+                groups.insert(producer[n]);
+
+        uint group;
+        if (groups.size() == 1)
+            group = *groups.begin();
+        else
+        {
+            group = members.size();
+            members.emplace_back();
+            predecessors.push_back(groups);
+        }
+        members[group].push_back(k);
+        for (auto n: entry.oports)
+            producer[n] = group;
+    }
+
+    const auto n = members.size();
+    std::vector<std::set<uint>> successors(n);
+    for (uint group = 0; group < n; group++)
+        for (auto p: predecessors[group])
+            successors[p].insert(group);
+    std::vector<double> cost(n, 0.0);
+    for (uint group = 0; group < n; group++)
+        for (auto k: members[group])
+            cost[group] += costs[k - first];
+
+    // small groups are merged into their only successor or predecessor, which can't make a cycle
+    std::vector<bool> merged(n, false);
+    auto merge = [&](uint from, uint into) -> void
+    {
+        members[into].insert(members[into].end(), members[from].begin(), members[from].end());
+        cost[into] += cost[from];
+        for (auto p: predecessors[from])
+        {
+            successors[p].erase(from);
+            if (p != into)
+            {
+                successors[p].insert(into);
+                predecessors[into].insert(p);
+            }
+        }
+        for (auto s: successors[from])
+        {
+            predecessors[s].erase(from);
+            if (s != into)
+            {
+                predecessors[s].insert(into);
+                successors[into].insert(s);
+            }
+        }
+        predecessors[into].erase(from);
+        successors[into].erase(from);
+        predecessors[from].clear();
+        successors[from].clear();
+        merged[from] = true;
+    };
+    for (bool progress = true; progress;)
+    {
+        progress = false;
+        for (uint group = 0; group < n; group++)
+        {
+            if (merged[group] or (cost[group] >= MIN_GROUP_COST))
+                continue;
+            if (successors[group].size() == 1)
+                merge(group, *successors[group].begin());
+            else if (predecessors[group].size() == 1)
+                merge(group, *predecessors[group].begin());
+            else
+                continue;
+            progress = true;
+        }
+    }
+
+    Plan plan;
+    std::vector<uint> index(n);
+    for (uint group = 0; group < n; group++)
+    {
+        if (merged[group])
+            continue;
+        index[group] = plan.groups.size();
+        std::sort(members[group].begin(), members[group].end());
+        plan.groups.push_back(std::move(members[group]));
+    }
+    const auto m = plan.groups.size();
+    plan.successors.resize(m);
+    plan.n_predecessors.resize(m);
+    std::vector<double> group_cost(m);
+    for (uint group = 0; group < n; group++)
+    {
+        if (merged[group])
+            continue;
+        group_cost[index[group]] = cost[group];
+        plan.n_predecessors[index[group]] = predecessors[group].size();
+        for (auto s: successors[group])
+            plan.successors[index[group]].push_back(index[s]);
+    }
+
+    // the critical path, in topological order
+    std::vector<double> finish(m, 0.0);
+    std::vector<uint> pending(plan.n_predecessors);
+    std::vector<uint> ready;
+    for (uint group = 0; group < m; group++)
+        if (pending[group] == 0)
+            ready.push_back(group);
+    double critical = 0;
+    while (not ready.empty())
+    {
+        auto group = ready.back();
+        ready.pop_back();
+        finish[group] += group_cost[group];
+        critical = std::max(critical, finish[group]);
+        for (auto s: plan.successors[group])
+        {
+            finish[s] = std::max(finish[s], finish[group]);
+            if (--pending[s] == 0)
+                ready.push_back(s);
+        }
+    }
+
+    const double total = std::accumulate(costs.cbegin(), costs.cend(), 0.0);
+    plan.parallel = (m > 1) and (total >= MIN_PARALLEL_COST) and (total >= MIN_SPEEDUP*critical);
+    return plan;
+}
+
+void Schedule::evaluate(double t, const NodeValues& x)
+{
+    // a hit is taken at the first recorded point at or after its time
+    for (auto& rate: _rates)
+    {
+        const auto period = rate.sample_time.period();
+        const auto offset = rate.sample_time.offset();
+        const auto eps = 1e-9*period;
+        rate.hit = t >= rate.next_hit - eps;
+        if (rate.hit)
+            rate.next_hit = offset + (std::floor((t + eps - offset)/period) + 1)*period;
+    }
+
+    _set_states(x);
+    _read_sources(t);
+    _evaluate(_first_varying_entry, _entries.size(), t, true);
+}
+
+void Schedule::evaluate_derivatives(double t, const NodeValues& x)
+{
+    _set_states(x);
+    _read_sources(t);
+    _evaluate(_first_varying_entry, _first_output_entry, t, false);
+}
+
+std::vector<std::size_t> Schedule::forward_cone(const std::vector<uint>& signals) const
+{
+    std::vector<bool> affected(_signals.first.size(), false);
+    for (auto k: signals)
+        affected[k] = true;
+
+    std::vector<std::size_t> ret;
+    for (std::size_t k = _first_varying_entry; k < _entries.size(); k++)
+    {
+        const auto& entry = _entries[k];
+        if ((entry.rate >= 0) or (not entry.block->has_direct_feedthrough()))
+            continue;
+        if (std::any_of(entry.iports.cbegin(), entry.iports.cend(), [&](uint n) {return affected[n];}))
+        {
+            ret.push_back(k);
+            for (auto n: entry.oports)
+                affected[n] = true;
+        }
+    }
+    return ret;
+}
+
+void Schedule::evaluate_entries(double t, const NodeValues& x, const std::vector<std::size_t>& entries)
+{
+    _set_states(x);
+    _read_sources(t);
+    for (auto k: entries)
+        _activate(_entries[k], t);
+}
+
+Scalars Schedule::zero_crossings(double t)
+{
+    Scalars ret;
+    for (auto k: _zc_entries)
+    {
+        auto& entry = _entries[k];
+        auto zc = entry.block->zero_crossings(t, entry.args);
+        ret.insert(ret.end(), zc.cbegin(), zc.cend());
+    }
+    return ret;
+}
+
+void Schedule::step(double t)
+{
+    for (auto& [block, rate]: _blocks)
+    {
+        if ((rate < 0) or _rates[rate].hit)
+            block->step(t, _signals);
+    }
+
+    if (not _n_directions)
+        return;
+    for (uint k = 0; k < _tangents.size(); k++)
+        _tangent(k);
+    for (auto& [block, rate]: _blocks)
+    {
+        if ((rate < 0) or _rates[rate].hit)
+            block->step_tangents(t, _signals, _tangents);
+    }
+}
+
+Values Schedule::derivatives() const
+{
+    Values ret;
+    ret.reserve((_n_directions ? 2 : 1)*_derivatives.size());
+    for (auto k: _derivatives)
+        ret.push_back(_signals.second[k]);
+    if (_n_directions)
+    {
+        for (auto k: _derivatives)
+        {
+            const auto& tangent = _tangents[k];
+            const auto n = _signals.second[k].size()*_n_directions;
+            if (tangent.size() == n)
+                ret.push_back(Map<const ArrayXd>(tangent.data(), n));
+            else
+                ret.push_back(Value::Zero(n));
+        }
+    }
+    return ret;
+}
+
+}
@@ -0,0 +1,201 @@
+#ifndef __SCHEDULE_HPP__
+#define __SCHEDULE_HPP__
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "blocks.hpp"
+#include "inputs.hpp"
+
+namespace blocks
+{
+
+class TaskPool;
+
+// a model compiled into a flat, topologically sorted list of block activations over a table of
+//   signals. each signal is classified by what it depends on so that constant and parameter-only
+//   subgraphs are evaluated once (per parameter change) instead of once per solver stage. the
+//   time-varying part is further split into the backward cone of the state derivatives, which
+//   the solver needs at every stage, and the remainder, which is only needed to record outputs.
+//   discrete blocks are only evaluated (and stepped) on their sample hits at recorded points and
+//   hold their outputs otherwise. blocks with zero crossings are evaluated at every stage, along
+//   with their backward cone, so that events can be located between recorded points.
+class Schedule
+{
+public:
+    enum class Dependency {constant, parameter, varying}; // sorted by increasing variability
+
+    // buses and bus selectors are evaluated by copying segments between signals
+    enum class Kind {block, bus, selector};
+
+    // a signal picked by a BusSelector: the field of a Bus, or a signal of a bus input, whose
+    //   (offset, size) in the input are known once its source has been read
+    struct Field
+    {
+        uint         signal;
+        std::string  name;      // in the bus input, empty for the field of a Bus
+        Eigen::Index offset{0};
+        Eigen::Index size{-1};  // negative until known
+    };
+
+    struct Entry
+    {
+        Base*             block;
+        Kind              kind{Kind::block};
+        std::vector<uint> iports;   // signal indices
+        std::vector<uint> oports;   // signal indices
+        NodeValues        args;     // reusable activation_function argument
+        Tangents          dargs;    // reusable tangents argument
+        bool              differentiated{false};
+        bool              in_place{false};  // activated through activate_in_place() on:
+        std::vector<const Value*> inputs;   //   the input signals
+        std::vector<Value*>       outputs;  //   the output signals
+        Dependency        dependency;
+        SampleTime        sample_time;
+        int               rate;     // index in _rates, negative if not discrete
+        std::vector<Field> fields;  // of a selector, one per oport
+    };
+
+    struct Rate
+    {
+        SampleTime sample_time;
+        double     next_hit;
+        bool       hit;
+    };
+
+    // a range of entries split into groups that can run concurrently once the groups they
+    //   depend on are done
+    struct Plan
+    {
+        bool parallel{false};
+        std::vector<std::vector<std::size_t>> groups;      // entries, in evaluation order
+        std::vector<std::vector<uint>>        successors;  // groups
+        std::vector<uint>                     n_predecessors;
+    };
+
+protected:
+    NodeValues              _signals;       // all the nodes of the model and their current values
+    std::vector<Dependency> _dependencies;  // one per signal
+    std::map<Node, uint>    _indices;       // node -> signal index
+
+    std::vector<Entry>      _entries;       // sorted by dependency, then topologically
+    std::size_t             _first_parameter_entry{0};
+    std::size_t             _first_varying_entry{0};
+    std::size_t             _first_output_entry{0};
+
+    std::vector<std::size_t> _zc_entries;   // varying entries with zero crossings
+    std::map<uint, std::size_t> _buses;     // bus signal -> the entry of its Bus
+    std::vector<Rate>       _rates;
+    std::vector<std::pair<Base*, int>> _blocks; // all the leaf blocks and their rates, for step()
+    bool                    _stepped_derivatives{false};  // step() may change the derivatives
+
+    std::vector<uint>       _states;
+    std::vector<uint>       _derivatives;
+    std::vector<uint>       _parameters;
+
+    std::vector<std::pair<uint, std::shared_ptr<InputSource>>> _sources;   // input signal, its source
+
+    uint                      _n_threads{1};
+    std::unique_ptr<TaskPool> _pool;
+    std::map<std::pair<std::size_t, std::size_t>, Plan> _plans;  // by range of entries
+
+    std::uint64_t           _hash;
+    static std::string      _cache_directory;
+
+    uint                    _n_directions{0};   // of the sensitivities, 0 if disabled
+    Tangents                _tangents;          // one per signal
+
+    uint _signal(const Node& node);
+    void _sort(std::vector<Entry>& pending, std::vector<bool>& known, const std::vector<const Base*>& stateful);
+    std::string _cache_path() const;
+    bool _read_cache(std::vector<Entry>& pending);
+    void _write_cache(const std::map<const Base*, std::size_t>& indices, std::size_t n_pending) const;
+    void _activate(Entry& entry, double t);
+    Field _field(uint bus, const std::string& name) const;
+    void _find_in_source(Field& field, const Base& selector) const;
+    void _set_states(const NodeValues& x);
+    void _read_sources(double t);
+    void _evaluate(std::size_t first, std::size_t last, double t, bool major);
+    Plan _plan(std::size_t first, std::size_t last, const std::vector<double>& costs) const;
+    void _differentiate(std::size_t first, std::size_t last, double t, bool major);
+    Tangent& _tangent(uint signal);
+
+public:
+    Schedule(Base& model, const States& states, const NodeValues& parameters=NodeValues(), const Nodes& inputs=Nodes());
+    // entries point into the signals
+    Schedule(const Schedule&) = delete;
+    Schedule& operator=(const Schedule&) = delete;
+    ~Schedule();
+
+    // evaluates independent groups of blocks concurrently on up to n_threads threads (0: one per
+    //   core) within each evaluation, where the first evaluation shows that it pays off. 1, the
+    //   default, evaluates sequentially.
+    void set_threads(uint n_threads);
+
+    // a hash of the structure of the model: the types, names, ports and sample times of its
+    //   blocks, its states, parameters and inputs. node names being deterministic, it is the same
+    //   for the same model in every run of a build.
+    std::uint64_t hash() const {return _hash;}
+
+    // where the sorted entries (their order, dependencies and resolved sample times) are saved by
+    //   hash(), so that a model compiled before skips the sort. empty, the default, disables it.
+    //   the values of the constant entries are always computed, since they depend on what the
+    //   blocks hold besides their structure (e.g. the gain of a Gain).
+    static void set_cache_directory(const std::string& directory);
+
+    const NodeValues& signals() const {return _signals;}
+    uint index(const Node& node) const;
+    Dependency dependency(uint signal) const {return _dependencies[signal];}
+    bool is_parameter(uint signal) const;
+
+    // re-evaluates the parameter-dependent part of the model
+    void set_parameters(const NodeValues& parameters);
+
+    // forward-mode sensitivities with respect to the given parameters, one direction per element.
+    //   the state vector is then augmented with the tangent of each state (flattened
+    //   column-major, in the same order), and derivatives() returns theirs after the derivatives.
+    void set_sensitivities(const Nodes& parameters);
+    uint n_directions() const {return _n_directions;}
+    const Tangent& tangent(uint signal) {return _tangent(signal);}
+
+    // inputs are held until they are set again
+    void set_inputs(const NodeValues& inputs);
+
+    // an input read from its source at every evaluation, solver stages included, instead of
+    //   being set. BusSelectors pick the signals of a BusInput by their names.
+    void set_input_source(const Node& input, std::shared_ptr<InputSource> source);
+
+    // evaluates the time-varying part of the model at a recorded point (t, x), including the
+    //   discrete blocks that have a sample hit at t
+    void evaluate(double t, const NodeValues& x);
+
+    // evaluates only what the state derivatives depend on, holding the discrete blocks
+    void evaluate_derivatives(double t, const NodeValues& x);
+
+    // the varying entries whose outputs change with the given signals within an evaluation, in
+    //   evaluation order. discrete entries are held and stop the propagation.
+    std::vector<std::size_t> forward_cone(const std::vector<uint>& signals) const;
+
+    // re-evaluates only the given entries (e.g. a forward cone) after evaluate()
+    void evaluate_entries(double t, const NodeValues& x, const std::vector<std::size_t>& entries);
+
+    // steps the blocks after evaluate(), skipping the discrete ones without a hit
+    void step(double t);
+
+    Values derivatives() const;
+
+    // whether the derivatives of an evaluation may be stale once the model has been stepped, in
+    //   which case they are to be evaluated again before being reused
+    bool step_changes_derivatives() const {return _stepped_derivatives;}
+
+    // the zero crossings of the last evaluation
+    bool has_zero_crossings() const {return not _zc_entries.empty();}
+    Scalars zero_crossings(double t);
+}; // class Schedule
+
+}
+
+#endif // __SCHEDULE_HPP__
@@ -0,0 +1,126 @@
+#ifndef __SERIALIZE_HPP__
+#define __SERIALIZE_HPP__
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "../3rdparty/eigen/Eigen/Core"
+
+namespace blocks
+{
+
+// native-endian binary (de)serialization of the block states, for checkpoints
+
+// FNV-1a, e.g. to tag what a cached file was made from. a text read in pieces is hashed by
+//   passing the hash of the pieces before as h.
+inline std::uint64_t fnv1a(std::string_view s, std::uint64_t h=14695981039346656037ull)
+{
+    for (auto c: s)
+    {
+        h ^= static_cast<unsigned char>(c);
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+// writes a file aside and renames it to path once it is complete, so that a concurrent reader
+//   never sees part of it. false if it couldn't be written.
+inline bool write_file_aside(const std::string& path, const std::function<void(std::ostream&)>& write)
+{
+    const auto tmp = path + "." + std::to_string(std::random_device()());
+    {
+        std::ofstream os(tmp, std::ios::binary);
+        write(os);
+        if (not os)
+        {
+            std::remove(tmp.c_str());
+            return false;
+        }
+    }
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+template<typename T, typename = std::enable_if_t<std::is_arithmetic<T>::value>>
+inline void write_binary(std::ostream& os, const T& v)
+{
+    os.write(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+template<typename T, typename = std::enable_if_t<std::is_arithmetic<T>::value>>
+inline void read_binary(std::istream& is, T& v)
+{
+    is.read(reinterpret_cast<char*>(&v), sizeof(T));
+}
+
+// the number of elements of size element_size that follow. a count of more than 256 MB of them
+//   is taken for a damaged file: it fails the stream instead of being allocated.
+inline bool read_count(std::istream& is, std::uint64_t& n, std::size_t element_size=1)
+{
+    read_binary(is, n);
+    if (is and (n > (std::uint64_t(1) << 28)/element_size))
+        is.setstate(std::ios::failbit);
+    return bool(is);
+}
+
+inline void write_binary(std::ostream& os, const std::string& v)
+{
+    write_binary(os, std::uint64_t(v.size()));
+    os.write(v.data(), v.size());
+}
+
+inline void read_binary(std::istream& is, std::string& v)
+{
+    std::uint64_t n;
+    if (not read_count(is, n))
+        return;
+    v.resize(n);
+    is.read(v.data(), n);
+}
+
+inline void write_binary(std::ostream& os, const Eigen::ArrayXd& v)
+{
+    write_binary(os, std::uint64_t(v.size()));
+    os.write(reinterpret_cast<const char*>(v.data()), v.size()*sizeof(double));
+}
+
+inline void read_binary(std::istream& is, Eigen::ArrayXd& v)
+{
+    std::uint64_t n;
+    if (not read_count(is, n, sizeof(double)))
+        return;
+    v.resize(n);
+    is.read(reinterpret_cast<char*>(v.data()), n*sizeof(double));
+}
+
+template<typename T>
+inline void write_binary(std::ostream& os, const std::vector<T>& v)
+{
+    write_binary(os, std::uint64_t(v.size()));
+    for (const auto& e: v)
+        write_binary(os, e);
+}
+
+template<typename T>
+inline void read_binary(std::istream& is, std::vector<T>& v)
+{
+    std::uint64_t n;
+    if (not read_count(is, n, sizeof(T)))
+        return;
+    v.resize(n);
+    for (auto& e: v)
+        if (is)
+            read_binary(is, e);
+}
+
+}
+
+#endif // __SERIALIZE_HPP__
@@ -1,7 +1,10 @@
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <ostream>
 #include <type_traits>
+#include <unordered_set>
 
 #include "blocks.hpp"
 #include "solver.hpp"
@@ -9,86 +12,365 @@
 namespace blocks
 {
 
-NodeValues rk4(SolverCallback callback, double t0, double t1, const NodeValues& x0)
-{
-    auto n = x0.first.size();
-    double h = t1 - t0;
-
-    // k1 = h*callback(t0, x0)
-    Values values = callback(t0, x0);
-    Values k1;
-    k1.reserve(n);
-    for (const auto& v: values)
-        k1.push_back(h*v);
-
-    // x1 = x0 + k1/2
-    Values x1;
-    x1.reserve(n);
-    auto k1_it = k1.begin();
-    for (const auto& v: x0.second)
-        x1.push_back(v + *(k1_it++)/2);
-
-    // k2 = h*callback(t0 + h/2, x1)
-    values = callback(t0 + h/2, NodeValues(x0.first, x1));
-    Values k2;
-    k2.reserve(n);
-    for (const auto& v: values)
-        k2.push_back(h*v);
-
-    // x2 = x0 + k2/2
-    Values x2;
-    x2.reserve(n);
-    auto k2_it = k2.begin();
-    for (const auto& v: x0.second)
-        x2.push_back(v + *(k2_it++)/2);
-
-    // k3 = h*callback(t0 + h/2, x2)
-    values = callback(t0 + h/2, NodeValues(x0.first, x2));
-    Values k3;
-    k3.reserve(n);
-    for (const auto& v: values)
-        k3.push_back(h*v);
-
-    // x3 = x0 + k3
-    Values x3;
-    x3.reserve(n);
-    auto k3_it = k3.begin();
-    for (const auto& v: x0.second)
-        x3.push_back(v + *(k3_it++));
-
-    // k4 = h*callback(t1, x3)
-    values = callback(t1, NodeValues(x0.first, x3));
-    Values k4;
-    k4.reserve(n);
-    for (const auto& v: values)
-        k4.push_back(h*v);
-
-    // ret = x0 + k1/6 + k2/3 + k3/3 + k4/6
-    Values ret;
-    ret.reserve(n);
-    k1_it = k1.begin();
-    k2_it = k2.begin();
-    k3_it = k3.begin();
-    auto k4_it = k4.begin();
-    for (const auto& v: x0.second)
-        ret.push_back(v + *(k1_it++)/6 + *(k2_it++)/3 + *(k3_it++)/3 + *(k4_it++)/6);
-
-    return NodeValues(x0.first, ret);
-}
-
-NodeValues simple(SolverCallback callback, double t0, double t1, const NodeValues& x0)
-{
-    double h = t1 - t0;
+StateLayout::StateLayout(const NodeValues& x) : _names(x.first)
+{
+    _offsets.reserve(x.second.size() + 1);
+    _offsets.push_back(0);
+    for (const auto& v: x.second)
+        _offsets.push_back(_offsets.back() + v.size());
+}
+
+std::size_t StateLayout::index(const Node& name) const
+{
+    auto it = std::find(_names.cbegin(), _names.cend(), name);
+    assert(it != _names.cend());
+    return std::distance(_names.cbegin(), it);
+}
+
+std::size_t StateLayout::state_of(Eigen::Index element) const
+{
+    assert((element >= 0) and (element < size()));
+    return std::distance(_offsets.cbegin(), std::upper_bound(_offsets.cbegin(), _offsets.cend(), element)) - 1;
+}
+
+std::string StateLayout::element_name(Eigen::Index element) const
+{
+    auto k = state_of(element);
+    if (size(k) == 1)
+        return _names[k];
+    return _names[k] + "[" + std::to_string(element - _offsets[k]) + "]";
+}
+
+void StateLayout::pack(const Values& values, VectorXd& v) const
+{
+    assert(values.size() == n_states());
+    v.resize(size());
+    for (std::size_t k = 0; k < values.size(); k++)
+    {
+        assert(values[k].size() == size(k));
+        v.segment(_offsets[k], size(k)) = values[k].matrix();
+    }
+}
+
+VectorXd StateLayout::pack(const Values& values) const
+{
+    VectorXd v;
+    pack(values, v);
+    return v;
+}
+
+void StateLayout::unpack(const VectorXd& v, Values& values) const
+{
+    assert((values.size() == n_states()) and (v.size() == size()));
+    for (std::size_t k = 0; k < values.size(); k++)
+        values[k] = v.segment(_offsets[k], size(k)).array();
+}
+
+VectorXd StateLayout::broadcast(const std::vector<double>& per_state) const
+{
+    assert(per_state.size() == n_states());
+    VectorXd v(size());
+    for (std::size_t k = 0; k < per_state.size(); k++)
+        v.segment(_offsets[k], size(k)).setConstant(per_state[k]);
+    return v;
+}
+
+// the steppers work on the packed states, and only unpack them to evaluate the derivatives
+
+NodeValues rk4(SolverCallback callback, double t0, double t1, const NodeValues& x0, const Values& dx0)
+{
+    const StateLayout layout(x0);
+    const double h = t1 - t0;
+    const VectorXd y0 = layout.pack(x0.second);
+
+    NodeValues x(x0);
+    auto k = [&](double t, const VectorXd& y) -> VectorXd
+    {
+        layout.unpack(y, x.second);
+        return h*layout.pack(callback(t, x));
+    };
+
+    const VectorXd k1 = h*layout.pack(dx0.empty() ? callback(t0, x0) : dx0);
+    const VectorXd k2 = k(t0 + h/2, y0 + k1/2);
+    const VectorXd k3 = k(t0 + h/2, y0 + k2/2);
+    const VectorXd k4 = k(t1, y0 + k3);
+
+    layout.unpack(y0 + k1/6 + k2/3 + k3/3 + k4/6, x.second);
+    return x;
+}
+
+NodeValues simple(SolverCallback callback, double t0, double t1, const NodeValues& x0, const Values& dx0)
+{
+    const StateLayout layout(x0);
+    const double h = t1 - t0;
 
     // ret = x0 + (t1 - t0)*callback(t0, x0)
-    Values values = callback(t0, x0);
-    Values ret;
-    ret.reserve(values.size());
-    auto x0_it = x0.second.begin();
-    for (auto& v: values)
-        ret.push_back(*(x0_it++) + h*v);
-
-    return NodeValues(x0.first, ret);
+    NodeValues ret(x0);
+    layout.unpack(layout.pack(x0.second) + h*layout.pack(dx0.empty() ? callback(t0, x0) : dx0), ret.second);
+    return ret;
+}
+
+// the weights of the quadrature over [0, 1] of the polynomial interpolating at the nodes, exact
+//   since the polynomial has a degree of at most 3
+static std::vector<double> interpolation_weights(const std::vector<double>& nodes)
+{
+    const double x[3] = {0.5 - std::sqrt(0.15), 0.5, 0.5 + std::sqrt(0.15)};
+    const double w[3] = {5.0/18, 8.0/18, 5.0/18};
+
+    std::vector<double> ret(nodes.size(), 0.0);
+    for (int q = 0; q < 3; q++)
+    {
+        for (std::size_t j = 0; j < nodes.size(); j++)
+        {
+            double l = 1;
+            for (std::size_t i = 0; i < nodes.size(); i++)
+                if (i != j)
+                    l *= (x[q] - nodes[i])/(nodes[j] - nodes[i]);
+            ret[j] += w[q]*l;
+        }
+    }
+    return ret;
+}
+
+AdamsBashforthMoulton::AdamsBashforthMoulton(uint order, double restart_tolerance) :
+    _order(order), _restart_tolerance(restart_tolerance)
+{
+    assert((order >= 1) and (order <= 4));
+}
+
+NodeValues AdamsBashforthMoulton::operator()(SolverCallback callback, double t0, double t1, const NodeValues& x0,
+    const Values& dx0)
+{
+    const StateLayout layout(x0);
+    const double h = t1 - t0;
+    const VectorXd y0 = layout.pack(x0.second);
+    const VectorXd f0 = layout.pack(dx0.empty() ? callback(t0, x0) : dx0);
+
+    if (not _history.empty())
+    {
+        bool continued = (t0 == _t1) and (y0.size() == _y1.size()) and (y0 == _y1);
+        if (continued and (_predicted.size() == f0.size()) and (f0.size() > 0))
+        {
+            const double scale = std::max(1.0, f0.lpNorm<Infinity>());
+            continued = (f0 - _predicted).lpNorm<Infinity>() <= _restart_tolerance*scale;
+        }
+        if (not continued)
+        {
+            _history.clear();
+            _n_restarts++;
+        }
+    }
+
+    _history.emplace(_history.begin(), t0, f0);
+    if (_history.size() > _order)
+        _history.pop_back();
+
+    NodeValues x(x0);
+    if (_history.size() < _order)
+    {
+        x = rk4(callback, t0, t1, x0, dx0.empty() ? Values() : dx0);
+        _predicted.resize(0);
+    }
+    else
+    {
+        // the nodes relative to the step, t0 at 0 and t1 at 1
+        std::vector<double> nodes;
+        for (const auto& [t, f]: _history)
+            nodes.push_back((t - t0)/h);
+
+        auto b = interpolation_weights(nodes);
+        VectorXd yp = y0;
+        for (std::size_t j = 0; j < _history.size(); j++)
+            yp += h*b[j]*_history[j].second;
+        layout.unpack(yp, x.second);
+        _predicted = layout.pack(callback(t1, x));
+
+        // the corrector interpolates the predicted derivative and all but the oldest one
+        nodes.pop_back();
+        nodes.insert(nodes.begin(), 1.0);
+        auto a = interpolation_weights(nodes);
+        VectorXd y1 = y0 + h*a[0]*_predicted;
+        for (std::size_t j = 1; j < nodes.size(); j++)
+            y1 += h*a[j]*_history[j - 1].second;
+        layout.unpack(y1, x.second);
+    }
+
+    _t1 = t1;
+    _y1 = layout.pack(x.second);
+    return x;
+}
+
+std::vector<std::pair<Node, Node>> position_velocity_pairs(Base& model)
+{
+    States states;
+    model.get_states(states);
+    const auto& names = std::get<0>(states);
+    const auto& derivatives = std::get<2>(states);
+
+    std::vector<std::pair<Node, Node>> ret;
+    std::unordered_set<std::string> paired;
+    for (std::size_t k = 0; k < names.size(); k++)
+    {
+        const auto& position = names[k];
+        const auto& velocity = derivatives[k];
+        if ((states.find(velocity) == names.cend()) or paired.count(position) or paired.count(velocity) or
+            (position == velocity))
+            continue;
+
+        ret.emplace_back(position, velocity);
+        paired.insert(position);
+        paired.insert(velocity);
+    }
+    return ret;
+}
+
+Symplectic::Symplectic(const Pairs& pairs, Method method) : _pairs(pairs)
+{
+    std::unordered_set<std::string> paired;
+    for (const auto& [position, velocity]: _pairs)
+    {
+        if ((not paired.insert(position).second) or (not paired.insert(velocity).second) or (position == velocity))
+        {
+            std::cout << "-- state paired more than once: " << position << ", " << velocity << "\n";
+            assert(false);
+        }
+    }
+
+    if (method == Method::verlet)
+        _weights = {1.0};
+    else
+    {
+        const double w1 = 1/(2 - std::cbrt(2.0));
+        _weights = {w1, 1 - 2*w1, w1};
+    }
+}
+
+NodeValues Symplectic::operator()(SolverCallback callback, double t0, double t1, const NodeValues& x0,
+    const Values& dx0) const
+{
+    const StateLayout layout(x0);
+    const double h = t1 - t0;
+
+    // the elements of the positions and of their velocities, and whether an element is kicked
+    auto find = [&](const Node& name) -> std::size_t
+    {
+        return std::find(x0.first.cbegin(), x0.first.cend(), name) - x0.first.cbegin();
+    };
+    std::vector<Eigen::Index> positions, velocities;
+    std::vector<bool> kicked(layout.size(), true);
+    auto pair = [&](const Node& position, const Node& velocity)
+    {
+        const auto p = find(position);
+        const auto v = find(velocity);
+        if ((p == x0.first.size()) or (v == x0.first.size()))
+            return;
+        assert(layout.size(p) == layout.size(v));
+        for (Eigen::Index e = 0; e < layout.size(p); e++)
+        {
+            positions.push_back(layout.offset(p) + e);
+            velocities.push_back(layout.offset(v) + e);
+            kicked[layout.offset(p) + e] = false;
+        }
+    };
+    for (const auto& [position, velocity]: _pairs)
+    {
+        pair(position, velocity);
+        pair("d(" + position + ")/dp", "d(" + velocity + ")/dp");
+    }
+
+    VectorXd y = layout.pack(x0.second);
+    VectorXd f = layout.pack(dx0.empty() ? callback(t0, x0) : dx0);
+    NodeValues x(x0);
+    auto kick = [&](double dt)
+    {
+        for (Eigen::Index e = 0; e < y.size(); e++)
+            if (kicked[e])
+                y[e] += dt*f[e];
+    };
+
+    // the kicks closing a Verlet step and opening the next one share their evaluation
+    double t = t0;
+    for (const auto w: _weights)
+    {
+        kick(w*h/2);
+        for (std::size_t n = 0; n < positions.size(); n++)
+            y[positions[n]] += w*h*y[velocities[n]];
+        t += w*h;
+
+        layout.unpack(y, x.second);
+        f = layout.pack(callback(t, x));
+        kick(w*h/2);
+    }
+
+    layout.unpack(y, x.second);
+    return x;
+}
+
+bool locate_event(Solver stepper, SolverCallback callback, ZCCallback zc_callback, double t0, const NodeValues& x0,
+    const Values& dx0, const Scalars& zc0, double& t1, NodeValues& x1)
+{
+    auto crossed = [](const Scalars& a, const Scalars& b) -> bool
+    {
+        assert(a.size() == b.size());
+        for (std::size_t k = 0; k < a.size(); k++)
+            if (((a[k] < 0) and (b[k] >= 0)) or ((a[k] > 0) and (b[k] <= 0)))
+                return true;
+        return false;
+    };
+
+    Scalars zc1 = zc_callback(t1, x1);
+    if (not crossed(zc0, zc1))
+        return false;
+
+    double lo = t0;
+    double hi = t1;
+    NodeValues x_hi = x1;
+    Scalars z_lo = zc0;
+    Scalars z_hi = zc1;
+    const double tol = 1e-9*(t1 - t0);
+    int side = 0;
+    for (int n = 0; (hi - lo > tol) and (n < 100); n++)
+    {
+        // the earliest of the secant estimates, falling back to bisection if it converges slowly
+        double t = hi;
+        if (n < 50)
+        {
+            for (std::size_t k = 0; k < z_lo.size(); k++)
+                if (crossed({z_lo[k]}, {z_hi[k]}))
+                    t = std::min(t, lo + (hi - lo)*z_lo[k]/(z_lo[k] - z_hi[k]));
+        }
+        else
+            t = (lo + hi)/2;
+        t = std::clamp(t, lo + tol/2, hi - tol/2);
+
+        auto x = stepper(callback, t0, t, x0, dx0);
+        auto z = zc_callback(t, x);
+        if (crossed(z_lo, z))
+        {
+            hi = t;
+            x_hi = x;
+            z_hi = z;
+            // Illinois: the same end kept twice in a row weighs half as much
+            if (side < 0)
+                for (auto& v: z_lo)
+                    v /= 2;
+            side = -1;
+        }
+        else
+        {
+            lo = t;
+            z_lo = z;
+            if (side > 0)
+                for (auto& v: z_hi)
+                    v /= 2;
+            side = 1;
+        }
+    }
+
+    // the step to hi overshoots the crossing by less than the tolerance
+    t1 = hi;
+    x1 = x_hi;
+    return true;
 }
 
 }
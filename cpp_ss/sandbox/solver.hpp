@@ -9,11 +9,109 @@ using namespace Eigen;
 namespace blocks
 {
 
+// the states packed into one vector, state k occupying the elements offset(k) to
+//   offset(k) + size(k) - 1, so that per-element data (e.g. tolerances) can be indexed
+class StateLayout
+{
+protected:
+    Nodes                     _names;
+    std::vector<Eigen::Index> _offsets;  // one more than the states, the last one is the size
+
+public:
+    StateLayout() : _offsets{0} {}
+    explicit StateLayout(const NodeValues& x);
+
+    std::size_t n_states() const {return _names.size();}
+    Eigen::Index size() const {return _offsets.back();}
+    const Node& name(std::size_t k) const {return _names[k];}
+    Eigen::Index offset(std::size_t k) const {return _offsets[k];}
+    Eigen::Index size(std::size_t k) const {return _offsets[k + 1] - _offsets[k];}
+    std::size_t index(const Node& name) const;
+
+    // the state an element belongs to, and its name: the state's, or e.g. "x[1]" for a vector state
+    std::size_t state_of(Eigen::Index element) const;
+    std::string element_name(Eigen::Index element) const;
+
+    void pack(const Values& values, VectorXd& v) const;
+    VectorXd pack(const Values& values) const;
+    // values must already hold one value per state, which are resized if needed
+    void unpack(const VectorXd& v, Values& values) const;
+
+    // one value per state to one per element, e.g. the absolute tolerances
+    VectorXd broadcast(const std::vector<double>& per_state) const;
+};
+
+// dx0, when not empty, is the already known derivative at (t0, x0) and saves the first evaluation
 using SolverCallback = std::function<Values(double, const NodeValues&)>;
-using Solver         = std::function<NodeValues(SolverCallback, double, double, const NodeValues&)>;
+using Solver         = std::function<NodeValues(SolverCallback, double, double, const NodeValues&, const Values&)>;
+
+NodeValues rk4   (SolverCallback callback, double t0, double t1, const NodeValues& x0, const Values& dx0=Values());
+NodeValues simple(SolverCallback callback, double t0, double t1, const NodeValues& x0, const Values& dx0=Values());
+
+// Adams-Bashforth predictor, Adams-Moulton corrector (PECE) of the given order (1 to 4) over the
+//   derivatives of the last steps, with coefficients for the actual, possibly varying, step sizes.
+//   a step takes one evaluation besides dx0, which run() gets for free. it keeps its history, so
+//   it is used as a Solver object, e.g. run(model, time_cb, inputs_cb, parameters,
+//   AdamsBashforthMoulton()), each copy with its own history. it bootstraps with rk4 and restarts
+//   when a step doesn't continue the previous one (e.g. after an event) or when the derivative
+//   jumps at its start by more than restart_tolerance (relative), e.g. on an input change.
+//   inputs held between recorded points jump at each of them, input sources are smooth.
+class AdamsBashforthMoulton
+{
+protected:
+    uint   _order;
+    double _restart_tolerance;
+
+    std::vector<std::pair<double, VectorXd>> _history;  // past (t, derivative), most recent first
+    double   _t1;         // the end of the last step
+    VectorXd _y1;         // its state
+    VectorXd _predicted;  // the derivative at its predicted state
+    uint     _n_restarts{0};
+
+public:
+    AdamsBashforthMoulton(uint order=4, double restart_tolerance=1e-4);
+
+    NodeValues operator()(SolverCallback callback, double t0, double t1, const NodeValues& x0, const Values& dx0=Values());
+
+    void restart() {_history.clear();}
+    uint n_restarts() const {return _n_restarts;}
+};
+
+using ZCCallback = std::function<Scalars(double, const NodeValues&)>;
+
+// the (position, velocity) pairs of the states of a model where the derivative of the position is
+//   the velocity, e.g. (x, xd) for Integrator(xdd -> xd) and Integrator(xd -> x). a state is in
+//   one pair at most.
+std::vector<std::pair<Node, Node>> position_velocity_pairs(Base& model);
+
+// velocity Verlet (kick-drift-kick, 2nd order) or its 4th order Yoshida composition of three
+//   steps. the positions drift with their velocities, the other states (the velocities, and e.g.
+//   controllers) get kicked with their derivatives. it conserves the energy of mechanical models
+//   over long runs at larger steps than rk4 if the forces only depend on the positions and time,
+//   the rest is integrated to 1st order. a step takes one (Verlet) or three (Yoshida) evaluations
+//   besides dx0. the sensitivities of the pairs are paired too.
+class Symplectic
+{
+public:
+    enum class Method {verlet, yoshida};
+    using Pairs = std::vector<std::pair<Node, Node>>;
+
+protected:
+    Pairs               _pairs;
+    std::vector<double> _weights;  // of the step, one per Verlet step
+
+public:
+    Symplectic(const Pairs& pairs, Method method=Method::verlet);
+    Symplectic(Base& model, Method method=Method::verlet) : Symplectic(position_velocity_pairs(model), method) {}
+
+    NodeValues operator()(SolverCallback callback, double t0, double t1, const NodeValues& x0, const Values& dx0=Values()) const;
+};
 
-NodeValues rk4   (SolverCallback callback, double t0, double t1, const NodeValues& x0);
-NodeValues simple(SolverCallback callback, double t0, double t1, const NodeValues& x0);
+// if a zero crossing changes sign over the step (t0, x0) -> (t1, x1), locates the first one by
+//   re-stepping from t0 (Illinois method). t1 is then moved right past it, within 1e-9 of the
+//   step, and x1 is the state there.
+bool locate_event(Solver stepper, SolverCallback callback, ZCCallback zc_callback, double t0, const NodeValues& x0,
+    const Values& dx0, const Scalars& zc0, double& t1, NodeValues& x1);
 
 }
 
@@ -0,0 +1,103 @@
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "blocks.hpp"
+#include "helper.hpp"
+
+using namespace blocks;
+
+static bool failed = false;
+
+static void check(bool ok, const std::string& what)
+{
+    if (not ok)
+    {
+        std::cout << "-- " << what << "\n";
+        failed = true;
+    }
+}
+
+// a chain of gains y_k = 2*y_(k-1), with a nested submodel in the middle
+class Chain : public Submodel
+{
+public:
+    Chain(uint n) : Submodel("")
+    {
+        enter();
+        {
+            for (uint k = 0; k < n; k++)
+            {
+                if (k == n/2)
+                {
+                    auto* nested = new Submodel("nested", Nodes(), Nodes());
+                    nested->enter();
+                    new Gain("K", 1.0, Nodes({"y" + std::to_string(k)}), Nodes({"z"}));
+                    nested->exit();
+                }
+                new Gain(("K" + std::to_string(k)).c_str(), 2.0, Nodes({"y" + std::to_string(k)}),
+                    Nodes({"y" + std::to_string(k + 1)}));
+            }
+            _n_chunks = arena()->n_chunks();
+        }
+        exit();
+    }
+
+    std::size_t _n_chunks;
+};
+
+// the blocks of a model are laid out in its arena in construction order, those of nested
+//   submodels included, and a clone is allocated from an arena of its own
+int main()
+{
+    const uint n = 2000;
+
+    // a block outside of any submodel is on the heap
+    check(Submodel::arena() == nullptr, "an arena outside of any submodel");
+    delete new Gain("K", 1.0, Nodes({"u"}), Nodes({"v"}));
+
+    std::unique_ptr<Base> clone;
+    {
+        Chain chain(n);
+        const auto& components = chain.components();
+        check(components.size() == n + 1, "wrong number of components");
+
+        // within a chunk, the gains are one after the other, a stride apart
+        const auto stride = reinterpret_cast<const char*>(components[1]) - reinterpret_cast<const char*>(components[0]);
+        uint n_contiguous = 0;
+        for (std::size_t k = 1; k < components.size(); k++)
+            if (reinterpret_cast<const char*>(components[k]) - reinterpret_cast<const char*>(components[k - 1]) == stride)
+                n_contiguous++;
+        std::cout << n + 1 << " blocks in " << chain._n_chunks << " chunk(s), " << n_contiguous << " a stride of "
+                  << stride << " bytes after the one before\n";
+        check((stride > 0) and (std::size_t(stride) < 2*sizeof(Gain)), "the first two gains are not next to each other");
+        // but for the first of each new chunk, and the one after the nested submodel (and its gain)
+        check(n_contiguous + (chain._n_chunks - 1) + 1 >= n, "the gains are not next to each other");
+
+        // the nested submodel's gain is allocated right after the submodel, before the next gain
+        const auto* nested = static_cast<const Submodel*>(components[n/2]);
+        const auto* inner = reinterpret_cast<const char*>(nested->components().front());
+        check((reinterpret_cast<const char*>(nested) < inner) and (inner < reinterpret_cast<const char*>(components[n/2 + 1])),
+            "the nested submodel's blocks are not in the outermost arena");
+
+        clone.reset(chain.clone());
+    }
+
+    // the clone outlives the model it was cloned from
+    auto history = run(*clone,
+        [](uint k, double& t) -> bool
+        {
+            return arange(k, t, 0, 1, 0.5);
+        },
+        [](double /*t*/, const NodeValues& /*outputs*/, NodeValues& inputs)
+        {
+            inputs.insert_or_assign("y0", 1.0);
+        },
+        NodeValues(), nullptr, Nodes(), 1, Observers());
+    check(history.at("y10")(2, 0) == 1024, "wrong output of the clone");
+    check(history.at("z")(2, 0) == std::ldexp(1.0, n/2), "wrong output of the clone's nested submodel");
+
+    std::cout << (failed ? "FAILED" : "passed") << "\n";
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,85 @@
+#include <iostream>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "blocks.hpp"
+
+using namespace blocks;
+
+static bool failed = false;
+
+static void check(bool ok, const std::string& what)
+{
+    if (not ok)
+    {
+        std::cout << "-- " << what << "\n";
+        failed = true;
+    }
+}
+
+// u -> K -> auto node -> K -> y, at the top and in two sibling submodels of the same name.
+//   the global nodes are prefixed, so that several models can be alive at once.
+class Model : public Submodel
+{
+public:
+    Model(const std::string& prefix) : Submodel("")
+    {
+        enter();
+        {
+            _add(prefix + "y");
+            for (int k = 0; k < 2; k++)
+            {
+                auto* sibling = new Submodel("S");
+                sibling->enter();
+                _add(prefix + "y" + std::to_string(k));
+                sibling->exit();
+            }
+        }
+        exit();
+    }
+
+    std::vector<std::string> _auto_nodes;
+
+private:
+    void _add(const std::string& y)
+    {
+        _auto_nodes.push_back((new Gain("K1", 1.0, Nodes({"u"}), Nodes({Node()})))->oports().front());
+        new Gain("K2", 2.0, Nodes({Node()}), Nodes({Node(y)}));
+    }
+};
+
+// auto nodes are unique within a model and among the live models, and a model built again gets
+//   the same names
+int main()
+{
+    std::vector<std::string> first, second;
+    {
+        Model a("a_"), b("b_");
+        first = a._auto_nodes;
+        second = b._auto_nodes;
+        for (const auto& node: first)
+            std::cout << node << " ";
+        for (const auto& node: second)
+            std::cout << node << " ";
+        std::cout << "\n";
+
+        std::set<std::string> nodes(first.cbegin(), first.cend());
+        nodes.insert(second.cbegin(), second.cend());
+        check(nodes.size() == first.size() + second.size(), "auto nodes are shared");
+    }
+
+    {
+        Model a("a_");
+        check(a._auto_nodes == first, "a model built again gets other names");
+        {
+            std::unique_ptr<Model> b(new Model("b_"));
+            check(b->_auto_nodes == second, "a second live model built again gets other names");
+        }
+        Model c("c_");
+        check(c._auto_nodes == second, "the number of a destroyed model isn't reused");
+    }
+
+    return failed ? 1 : 0;
+}
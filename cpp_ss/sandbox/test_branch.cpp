@@ -0,0 +1,111 @@
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+#include "blocks.hpp"
+#include "helper.hpp"
+#include "solver.hpp"
+
+using namespace blocks;
+
+class Model : public Submodel
+{
+public:
+    Model() : Submodel("")
+    {
+        enter();
+        {
+            new Delay("D", {"u", "d", "z"}, {"ud"});
+            new AddSub("e", "+-", {"ud", "x"}, "e");
+            new Integrator("I", "e", "x");
+            new Derivative("dx", "x", "xdot");
+            new Memory("M", "x", "xm");
+        }
+        exit();
+    }
+};
+
+static bool arange_from(uint k, double& t, double t_init)
+{
+    return arange(k, t, t_init, t_init + 5, 0.1);
+}
+
+static void inputs_cb(double t, const NodeValues& /*outputs*/, NodeValues& inputs)
+{
+    inputs.insert_or_assign("u", std::sin(t));
+}
+
+static double difference(const History& a, const History& b)
+{
+    double ret = 0;
+    for (const auto& [node, values]: a)
+    {
+        auto it = b.find(node);
+        if ((it == b.end()) or (it->second.rows() != values.rows()))
+            return std::numeric_limits<double>::infinity();
+        ret = std::max(ret, (it->second - values).cwiseAbs().maxCoeff());
+    }
+    return ret;
+}
+
+// a run to t = 5 branched into 300 continuations to t = 10 with 3 delays, on 4 threads. each one
+//   is the continuation of a model restored from a checkpoint at t = 5 with its delay, and the
+//   branched model goes on as if it hadn't been.
+//   the threads are also checked by building with CXXFLAGS="... -fsanitize=thread" (and the same
+//   in LDFLAGS).
+int main()
+{
+    const std::vector<double> delays = {0.3, 0.5, 1.0};
+    const NodeValues parameters = {{"d", 0.3}, {"z", 0.0}};
+
+    // the references, one model at a time
+    std::stringstream blob;
+    {
+        Model model;
+        run(model, [](uint k, double& t) {return arange_from(k, t, 0);}, inputs_cb, parameters, rk4, Nodes(), 1, Observers());
+        checkpoint(model, blob);
+    }
+    std::vector<History> references;
+    for (auto d: delays)
+    {
+        Model model;
+        blob.clear();
+        blob.seekg(0);
+        restore(model, blob);
+        references.push_back(run(model, [](uint k, double& t) {return arange_from(k, t, 5);}, inputs_cb,
+            NodeValues({{"d", d}, {"z", 0.0}}), rk4, Nodes(), 1, Observers()));
+    }
+
+    Model model;
+    run(model, [](uint k, double& t) {return arange_from(k, t, 0);}, inputs_cb, parameters, rk4, Nodes(), 1, Observers());
+
+    std::vector<Scenario> scenarios;
+    for (uint k = 0; k < 300; k++)
+        scenarios.push_back({[](uint k, double& t) {return arange_from(k, t, 5);}, inputs_cb,
+            NodeValues({{"d", delays[k%delays.size()]}, {"z", 0.0}}), rk4, Observers()});
+    auto histories = branch(model, scenarios, 4);
+
+    bool ok = (histories.size() == scenarios.size());
+    double error = 0;
+    for (uint k = 0; ok and (k < histories.size()); k++)
+        error = std::max(error, difference(references[k%delays.size()], histories[k]));
+    std::cout << histories.size() << " branches, largest difference from the references: " << error << "\n";
+    if ((not ok) or (error > 0))
+    {
+        std::cout << "-- the branches differ from the runs restored from a checkpoint\n";
+        return 1;
+    }
+
+    auto history = run(model, [](uint k, double& t) {return arange_from(k, t, 5);}, inputs_cb, parameters, rk4,
+        Nodes(), 1, Observers());
+    error = difference(references[0], history);
+    std::cout << "the branched model, largest difference from the reference: " << error << "\n";
+    if (error > 0)
+    {
+        std::cout << "-- branching changed the model\n";
+        return 1;
+    }
+
+    return 0;
+}
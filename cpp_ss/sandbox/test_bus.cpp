@@ -0,0 +1,102 @@
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "blocks.hpp"
+#include "helper.hpp"
+#include "model_file.hpp"
+#include "solver.hpp"
+
+using namespace blocks;
+
+static bool failed = false;
+
+static void check(bool ok, const std::string& what)
+{
+    if (not ok)
+    {
+        std::cout << "-- " << what << "\n";
+        failed = true;
+    }
+}
+
+// a bus of a bus of a and the vector c, and of b, and a bus of the local node v = 2*a of a
+//   submodel. x' = b, and the selected signals are those of the buses.
+class Model : public Submodel
+{
+public:
+    Model() : Submodel("")
+    {
+        enter();
+        {
+            new Bus("inner", {"a", "c"}, "inner");
+            new Bus("outer", {"inner", "b"}, "outer");
+            new BusSelector("S", "outer", {"inner.c", "b"}, {"sc", "sb"});
+            new Integrator("I", "sb", "x");
+
+            auto* local = new Submodel("P");
+            local->enter();
+            new Gain("K", 2.0, Nodes({"a"}), Nodes({"-v"}));
+            new Bus("local", Nodes({"-v"}), "local");
+            local->exit();
+            // the signal is the name of the oport
+            new BusSelector("L", "local", {}, {"-v"});
+        }
+        exit();
+    }
+};
+
+static const char* model_file = R"(
+Bus inner iports=a,c oport=inner
+Bus outer iports=inner,b oport=outer
+BusSelector S iport=outer signals=inner.c,b oports=sc,sb
+Integrator I iport=sb oport=x
+)";
+
+static History simulate(Base& model, const Value& c, const Nodes& sensitivities=Nodes())
+{
+    return run(model,
+        [](uint k, double& t) -> bool
+        {
+            return arange(k, t, 0, 1, 0.1);
+        },
+        nullptr, NodeValues({{"a", 3.0}, {"b", 0.5}, {"c", c}}), rk4, sensitivities, 1, Observers());
+}
+
+// the signals are picked by name out of nested buses, the same for a model built from a file, and
+//   for a second run with another size of c. dx/db = t goes through the selector.
+int main()
+{
+    Value c2(2), c3(3);
+    c2 << 1, 2;
+    c3 << 4, 5, 6;
+
+    std::unique_ptr<Base> model(new Model());
+    for (const auto& c: {c2, c3})
+    {
+        const auto history = simulate(*model, c, {"b"});
+        const auto& t = history.at("t");
+        const auto n = t.rows() - 1;
+        check((history.at("sc").cols() == c.size()) and (history.at("sc").row(n).transpose().array() == c).all(),
+            "wrong sc");
+        check(history.at("sb")(n, 0) == 0.5, "wrong sb");
+        // the second run goes on from the state of the first
+        check(std::abs(history.at("x")(n, 0) - history.at("x")(0, 0) - 0.5*t(n, 0)) < 1e-12, "wrong x");
+        check(std::abs(history.at("d(x)/d(b)")(n, 0) - t(n, 0)) < 1e-12, "wrong dx/db");
+        std::cout << "c of size " << c.size() << ": sc = " << history.at("sc").row(n) << ", x = "
+                  << history.at("x")(n, 0) << ", dx/db = " << history.at("d(x)/d(b)")(n, 0) << "\n";
+    }
+    // local nodes aren't recorded
+    model.reset();
+
+    std::istringstream is(model_file);
+    auto built = build_model(parse_model(is));
+    const auto history = simulate(*built, c2);
+    const auto n = history.at("t").rows() - 1;
+    check((history.at("sc").row(n).transpose().array() == c2).all() and (history.at("sb")(n, 0) == 0.5),
+        "wrong signals of the model file");
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,84 @@
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "blocks.hpp"
+#include "calibration.hpp"
+#include "helper.hpp"
+
+using namespace blocks;
+
+static bool failed = false;
+
+static void check(bool ok, const std::string& what)
+{
+    if (not ok)
+    {
+        std::cout << "-- " << what << "\n";
+        failed = true;
+    }
+}
+
+// tau*y' = k*u - y, stepped at 0.5, fitted to its own response to k = 2, tau = 0.3 (every 0.05)
+//   from k = 1, tau = 1: both methods find them, and with k bounded by 1.5, k stops at the bound
+int main()
+{
+    Submodel model("");
+    model.enter();
+    new MulDiv("ku", "**", {"k", "u"}, "ku");
+    new AddSub("e", "+-", {"ku", "y"}, "e");
+    new MulDiv("dy", "*/", {"e", "tau"}, "dy");
+    new Integrator("I", "dy", "y", Value::Zero(1));
+    model.exit();
+
+    auto time_cb = [](uint k, double& t) -> bool
+    {
+        return arange(k, t, 0, 3, 0.01);
+    };
+    auto inputs_cb = [](double t, const NodeValues& /*outputs*/, NodeValues& inputs)
+    {
+        inputs.insert_or_assign("u", (t >= 0.5) ? 1.0 : 0.0);
+    };
+
+    Reference reference{"y", {}, {}};
+    {
+        std::unique_ptr<Base> clone(model.clone());
+        auto history = run(*clone, time_cb, inputs_cb, NodeValues({{"k", 2.0}, {"tau", 0.3}}), rk4, Nodes(), 1,
+            Observers());
+        for (Eigen::Index n = 0; n < history.at("t").rows(); n += 5)
+        {
+            reference.t.push_back(history.at("t")(n, 0));
+            reference.y.push_back(history.at("y")(n, 0));
+        }
+    }
+
+    const NodeValues initial({{"k", 1.0}, {"tau", 1.0}});
+    for (auto method: {CalibrationOptions::Method::levenberg_marquardt, CalibrationOptions::Method::nelder_mead})
+    {
+        const std::string name = (method == CalibrationOptions::Method::nelder_mead) ? "Nelder-Mead" : "Levenberg-Marquardt";
+        CalibrationOptions options;
+        options.method = method;
+        options.n_threads = 4;
+        options.max_iterations = 300;
+        auto result = calibrate(model, time_cb, inputs_cb, initial, {{"k", 0.1, 10}, {"tau", 0.01, 5}}, {reference},
+            options);
+
+        const double k = result.parameters.at("k")[0], tau = result.parameters.at("tau")[0];
+        std::cout << name << ": k = " << k << ", tau = " << tau << ", cost " << result.cost << " after "
+                  << result.iterations << " iterations and " << result.n_runs << " runs\n";
+        check(result.converged and (std::abs(k - 2) < 1e-6) and (std::abs(tau - 0.3) < 1e-6),
+            name + " doesn't find k = 2, tau = 0.3");
+    }
+
+    auto bounded = calibrate(model, time_cb, inputs_cb, initial, {{"k", 0.1, 1.5}, {"tau", 0.01, 5}}, {reference});
+    std::cout << "bounded: k = " << bounded.parameters.at("k")[0] << ", tau = " << bounded.parameters.at("tau")[0] << "\n";
+    check(bounded.converged and (bounded.parameters.at("k")[0] == 1.5), "the bounded k doesn't stop at its bound");
+
+    // the runs were on clones
+    States states;
+    model.get_states(states);
+    check(std::get<1>(states).front()[0] == 0, "the model was run");
+
+    return failed ? 1 : 0;
+}
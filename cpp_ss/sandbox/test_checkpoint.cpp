@@ -0,0 +1,80 @@
+#include <cmath>
+#include <iostream>
+#include <sstream>
+
+#include "blocks.hpp"
+#include "helper.hpp"
+#include "solver.hpp"
+
+using namespace blocks;
+
+// a block of each kind with a state: a delay line, an integrator, a derivative and a memory
+class Model : public Submodel
+{
+public:
+    Model() : Submodel("")
+    {
+        enter();
+        {
+            new Delay("D", {"u", "d", "z"}, {"ud"});
+            new AddSub("e", "+-", {"ud", "x"}, "e");
+            new Integrator("I", "e", "x");
+            new Derivative("dx", "x", "xdot");
+            new Memory("M", "x", "xm");
+        }
+        exit();
+    }
+};
+
+static const NodeValues parameters = {{"d", 0.3}, {"z", 0.0}};
+
+static History simulate(Base& model, double t_init, double t_end)
+{
+    return run(model,
+        [t_init, t_end](uint k, double& t) -> bool
+        {
+            return arange(k, t, t_init, t_end, 0.1);
+        },
+        [](double t, const NodeValues& /*outputs*/, NodeValues& inputs)
+        {
+            inputs.insert_or_assign("u", std::sin(t));
+        },
+        parameters, rk4, Nodes(), 1, Observers());
+}
+
+// a run checkpointed at t = 5 and restored into a new model goes on as the one that wasn't stopped
+int main()
+{
+    History full;
+    {
+        Model model;
+        full = simulate(model, 0, 10);
+    }
+
+    std::stringstream blob;
+    {
+        Model model;
+        simulate(model, 0, 5);
+        checkpoint(model, blob);
+    }
+
+    History second;
+    {
+        Model model;
+        restore(model, blob);
+        second = simulate(model, 5, 10);
+    }
+
+    const auto offset = full.at("t").rows() - second.at("t").rows();
+    double error = 0;
+    for (auto node: {"t", "x", "xdot", "xm", "ud"})
+        error = std::max(error, (second.at(node) - full.at(node).bottomRows(second.at(node).rows())).cwiseAbs().maxCoeff());
+    std::cout << "restored at t = " << full.at("t")(offset, 0) << ", largest difference: " << error << "\n";
+    if (error > 1e-12)
+    {
+        std::cout << "-- the restored run differs from the uninterrupted one\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,52 @@
+#include <cmath>
+#include <iostream>
+#include <string>
+
+#include "helper.hpp"
+
+using namespace blocks;
+
+static bool failed = false;
+
+static void check(bool ok, const std::string& what)
+{
+    if (not ok)
+    {
+        std::cout << "-- " << what << "\n";
+        failed = true;
+    }
+}
+
+// 10000 samples of a sine down to a few pixels: minmax keeps the extremes, lttb one sample per
+//   pixel, and fewer than 3 pixels (or samples all at the same time) only the first and last
+//   samples
+int main()
+{
+    const Eigen::Index n = 10000;
+    MatrixXd t(n, 1), y(n, 1), same_t = MatrixXd::Zero(n, 1);
+    for (Eigen::Index k = 0; k < n; k++)
+    {
+        t(k, 0) = 0.001*k;
+        y(k, 0) = std::sin(t(k, 0));
+    }
+
+    const auto minmax = downsample(t, y, 0, 100);
+    check((minmax.rows() <= 400) and (minmax.col(1).maxCoeff() == y.maxCoeff()) and
+        (minmax.col(1).minCoeff() == y.minCoeff()), "minmax doesn't keep the extremes");
+    check(downsample(t, y, 0, 100, Downsampling::lttb).rows() == 100, "lttb doesn't keep a sample per pixel");
+
+    for (uint n_pixels: {1u, 2u})
+    {
+        for (const auto* times: {&t, &same_t})
+        {
+            const auto points = downsample(*times, y, 0, n_pixels, Downsampling::lttb);
+            check((points.rows() == 2) and (points(0, 0) == (*times)(0, 0)) and (points(0, 1) == y(0, 0)) and
+                (points(1, 0) == (*times)(n - 1, 0)) and (points(1, 1) == y(n - 1, 0)),
+                "not the first and last samples on " + std::to_string(n_pixels) + " pixel(s)");
+        }
+    }
+    check(downsample(same_t, y, 0, 3).rows() == 3, "samples at the same time not downsampled");
+    std::cout << "minmax: " << minmax.rows() << " samples, lttb on 1 and 2 pixels: 2\n";
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "blocks.hpp"
+#include "helper.hpp"
+#include "observer.hpp"
+#include "solver.hpp"
+
+using namespace blocks;
+
+static bool failed = false;
+
+static void check(bool ok, const std::string& what)
+{
+    if (not ok)
+    {
+        std::cout << "-- " << what << "\n";
+        failed = true;
+    }
+}
+
+// how far q is from the ranks of v among the sorted values, which are a range if v is repeated
+static double rank_error(double v, const std::vector<double>& sorted, double q)
+{
+    const auto n = double(sorted.size());
+    const auto lo = std::lower_bound(sorted.cbegin(), sorted.cend(), v) - sorted.cbegin();
+    const auto hi = std::upper_bound(sorted.cbegin(), sorted.cend(), v) - sorted.cbegin();
+    return std::max({0.0, lo/n - q, q - hi/n});
+}
+
+static double rank_error(const QuantileSketch& sketch, const std::vector<double>& sorted)
+{
+    double ret = 0;
+    for (double q = 0.01; q < 1; q += 0.01)
+        ret = std::max(ret, rank_error(sketch.quantile(q), sorted, q));
+    return ret;
+}
+
+// the quantiles of a sketch of 100000 values, and of 4 sketches of parts of them merged, are
+//   within 2/k in rank. the statistics of x' = -k*x over 300 runs with random k at the times of
+//   a grid are those of the full histories, which aren't kept.
+int main()
+{
+    const uint k = 64;
+    std::mt19937 generator(3);
+
+    {
+        std::vector<double> values(100000);
+        std::iota(values.begin(), values.end(), 0.0);
+        std::shuffle(values.begin(), values.end(), generator);
+
+        QuantileSketch sketch(k);
+        std::vector<QuantileSketch> parts(4, QuantileSketch(k));
+        for (std::size_t n = 0; n < values.size(); n++)
+        {
+            sketch.add(values[n]);
+            parts[n%parts.size()].add(values[n]);
+        }
+        QuantileSketch merged(k);
+        for (const auto& part: parts)
+            merged.merge(part);
+
+        std::sort(values.begin(), values.end());
+        const auto error = rank_error(sketch, values), merged_error = rank_error(merged, values);
+        std::cout << "sketch: " << sketch.n() << " values, largest rank error: " << error << ", merged: "
+                  << merged.n() << " values, largest rank error: " << merged_error << "\n";
+        check((sketch.n() == values.size()) and (merged.n() == values.size()), "the sketches lost values");
+        check(std::max(error, merged_error) < 2.0/k, "the sketches' quantiles are off");
+    }
+
+    Submodel model("");
+    model.enter();
+    new Integrator("I", "dx", "x", Value::Ones(1));
+    new MulDiv("kx", "**", {"x", "k"}, "dx", -1);
+    model.exit();
+
+    const uint n_runs = 300;
+    std::vector<double> grid;
+    for (int n = 0; n <= 10; n++)
+        grid.push_back(0.1*n);
+    EnsembleStatistics statistics(grid, {"x", "dx"}, k);
+
+    std::vector<Scenario> streamed, kept;
+    std::uniform_real_distribution<double> distribution(0.5, 2.0);
+    double mean_k = 0;
+    auto time_cb = [](uint k, double& t) -> bool
+    {
+        return arange(k, t, 0, 1, 0.05);
+    };
+    for (uint n = 0; n < n_runs; n++)
+    {
+        const double k = distribution(generator);
+        mean_k += k/n_runs;
+        NodeValues parameters({"k"}, {Value::Constant(1, k)});
+        streamed.push_back({time_cb, nullptr, parameters, rk4, {statistics.observer()}, false});
+        kept.push_back({time_cb, nullptr, parameters, rk4, Observers(), true});
+    }
+    const auto empty = branch(model, streamed, 4);
+    const auto histories = branch(model, kept, 4);
+    check(std::all_of(empty.cbegin(), empty.cend(), [](const History& h) {return h.empty();}),
+        "histories kept without keep_history");
+
+    const auto counts = statistics.counts();
+    check((counts.size() == grid.size()) and std::all_of(counts.cbegin(), counts.cend(), [](double n) {return n == n_runs;}),
+        "wrong counts");
+
+    // the grid's times are every other recorded point
+    double error = 0, quantile_error = 0;
+    for (std::size_t n = 0; n < grid.size(); n++)
+    {
+        std::vector<double> x;
+        for (const auto& history: histories)
+            x.push_back(history.at("x")(2*n, 0));
+        const double mean = std::accumulate(x.cbegin(), x.cend(), 0.0)/n_runs;
+        double variance = 0;
+        for (auto v: x)
+            variance += (v - mean)*(v - mean)/(n_runs - 1);
+        std::sort(x.begin(), x.end());
+
+        error = std::max({error, std::abs(statistics.mean("x")(n, 0) - mean),
+            std::abs(statistics.variance("x")(n, 0) - variance),
+            std::abs(statistics.min("x")(n, 0) - x.front()), std::abs(statistics.max("x")(n, 0) - x.back())});
+        for (double q: {0.05, 0.5, 0.95})
+            quantile_error = std::max(quantile_error, rank_error(statistics.quantile("x", q)(n, 0), x, q));
+    }
+    std::cout << "ensemble of " << n_runs << " runs: largest error: " << error << ", largest quantile rank error: "
+              << quantile_error << "\n";
+    check(error < 1e-12, "the statistics differ from those of the histories");
+    check(quantile_error < 2.0/k, "the quantiles are off");
+    // dx = -k at t = 0
+    check(std::abs(statistics.mean("dx")(0, 0) + mean_k) < 1e-12, "wrong statistics of a second output");
+
+    return failed ? 1 : 0;
+}
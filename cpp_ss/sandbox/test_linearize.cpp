@@ -0,0 +1,69 @@
+#include <cmath>
+#include <iostream>
+
+#include "blocks.hpp"
+#include "helper.hpp"
+
+using namespace blocks;
+
+// a pendulum driven by u: phi'' = -g/l*sin(phi) + u, with an output y2 = 3*u not depending on it
+class Model : public Submodel
+{
+public:
+    Model() : Submodel("")
+    {
+        enter();
+        {
+            new Integrator("dphi", "d2phi", "dphi");
+            new Integrator("phi", "dphi", "phi", 0.3);
+            new Sin("s", {"phi"}, {"sphi"});
+            new MulDiv("-g/l", "**/", {"sphi", "g", "l"}, "a", -1);
+            new AddSub("sum", "++", {"a", "u"}, "d2phi");
+            new Gain("y2", 3.0, {"u"}, {"y2"});
+        }
+        exit();
+    }
+};
+
+// around phi = 0.5, the matrices of (dphi, phi), u and (phi, d2phi, y2) are, with a = -g/l*cos(0.5):
+//   A = [0 a; 1 0], B = [1; 0], C = [0 1; 0 a; 0 0], D = [0; 1; 3], serially and on 4 threads
+int main()
+{
+    Model model;
+    const NodeValues parameters = {{"g", 9.81}, {"l", 2.0}};
+    const double a = -9.81/2*std::cos(0.5);
+
+    bool ok = true;
+    for (uint n_threads: {1u, 4u})
+    {
+        auto linear = linearize(model, 0.0, {{"phi", 0.5}}, {{"u", 0.1}}, {"u"}, {"phi", "d2phi", "y2"}, parameters,
+            n_threads);
+        if ((linear.states.size() != 2) or (linear.A.rows() != 2) or (linear.B.cols() != 1) or (linear.C.rows() != 3))
+        {
+            std::cout << "-- wrong sizes on " << n_threads << " thread(s)\n";
+            return 1;
+        }
+
+        // the states are in the model's order
+        const Eigen::Index dphi = (linear.states[0] == "dphi") ? 0 : 1;
+        const Eigen::Index phi = 1 - dphi;
+        MatrixXd A = MatrixXd::Zero(2, 2), B = MatrixXd::Zero(2, 1), C = MatrixXd::Zero(3, 2), D(3, 1);
+        A(dphi, phi) = a;
+        A(phi, dphi) = 1;
+        B(dphi, 0) = 1;
+        C(0, phi) = 1;
+        C(1, phi) = a;
+        D << 0, 1, 3;
+
+        const double error = std::max({(linear.A - A).cwiseAbs().maxCoeff(), (linear.B - B).cwiseAbs().maxCoeff(),
+            (linear.C - C).cwiseAbs().maxCoeff(), (linear.D - D).cwiseAbs().maxCoeff()});
+        std::cout << n_threads << " thread(s): largest error: " << error << "\n";
+        if (error > 1e-6)
+        {
+            std::cout << "-- the linear model differs from the analytic one on " << n_threads << " thread(s)\n";
+            ok = false;
+        }
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if __has_include(<zlib.h>)
+#include <zlib.h>
+#define TEST_ZLIB
+#endif
+
+#include "blocks.hpp"
+#include "helper.hpp"
+#include "mat_file.hpp"
+
+using namespace blocks;
+
+// writes level 5 MAT files in either byte order, the way MATLAB does
+class MatWriter
+{
+protected:
+    bool _big;
+
+    template<typename T>
+    void _put(std::string& s, T v) const
+    {
+        char b[sizeof(T)];
+        std::memcpy(b, &v, sizeof(T));
+        if (_big)
+            std::reverse(b, b + sizeof(T));
+        s.append(b, sizeof(T));
+    }
+
+public:
+    MatWriter(bool big) : _big(big) {}
+
+    std::string element(std::uint32_t type, const std::string& data) const
+    {
+        std::string ret;
+        if ((data.size() <= 4) and (type != 15))
+        {
+            // the small format
+            _put(ret, std::uint32_t((data.size() << 16) | type));
+            ret += data + std::string(4 - data.size(), '\0');
+            return ret;
+        }
+        _put(ret, type);
+        _put(ret, std::uint32_t(data.size()));
+        ret += data;
+        if (type != 15)
+            ret += std::string((8 - data.size()%8)%8, '\0');
+        return ret;
+    }
+
+    // a rows x cols array of class cls, its values stored as T with data type type
+    template<typename T>
+    std::string matrix(const std::string& name, const std::vector<std::vector<double>>& rows, std::uint32_t cls,
+        std::uint32_t type, bool complex=false) const
+    {
+        std::string flags, dimensions, values;
+        _put(flags, std::uint32_t(cls | (complex ? 0x800 : 0)));
+        _put(flags, std::uint32_t(0));
+        _put(dimensions, std::int32_t(rows.size()));
+        _put(dimensions, std::int32_t(rows.front().size()));
+        for (std::size_t j = 0; j < rows.front().size(); j++)
+            for (const auto& row: rows)
+                _put(values, T(row[j]));
+        auto body = element(6, flags) + element(5, dimensions) + element(1, name) + element(type, values);
+        if (complex)
+            body += element(type, values);
+        return element(14, body);
+    }
+
+    std::string header() const
+    {
+        auto ret = std::string("MATLAB 5.0 MAT-file, test");
+        ret.resize(116, ' ');
+        ret += std::string(8, '\0');
+        _put(ret, std::uint16_t(0x0100));
+        std::string endian;
+        _put(endian, std::uint16_t(('M' << 8) | 'I'));
+        return ret + endian;
+    }
+
+#ifdef TEST_ZLIB
+    std::string compressed(const std::string& s) const
+    {
+        uLongf n = compressBound(s.size());
+        std::string z(n, '\0');
+        compress(reinterpret_cast<Bytef*>(&z[0]), &n, reinterpret_cast<const Bytef*>(s.data()), s.size());
+        z.resize(n);
+        return element(15, z);
+    }
+#endif
+};
+
+static bool failed = false;
+
+static void check(bool ok, const std::string& what)
+{
+    if (not ok)
+    {
+        std::cout << "-- " << what << "\n";
+        failed = true;
+    }
+}
+
+static void write(const std::filesystem::path& path, const std::string& s)
+{
+    std::ofstream(path, std::ios::binary) << s;
+}
+
+// the rows (t, 2t, -t) for t = 0, 0.25, ..., 1
+static std::vector<std::vector<double>> table()
+{
+    std::vector<std::vector<double>> ret;
+    for (int k = 0; k <= 4; k++)
+        ret.push_back({0.25*k, 0.5*k, -0.25*k});
+    return ret;
+}
+
+static void check_table(const MatFile& file, const std::string& what)
+{
+    const auto& data = file.at("data");
+    const auto expected = table();
+    bool ok = (data.rows() == 5) and (data.cols() == 3);
+    for (std::size_t i = 0; ok and (i < expected.size()); i++)
+        for (std::size_t j = 0; j < 3; j++)
+            ok = ok and (data.matrix()(i, j) == expected[i][j]);
+    check(ok, what + ": wrong data");
+}
+
+int main()
+{
+    const auto root = std::filesystem::temp_directory_path()/"test_mat_file";
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directories(root);
+
+    // both byte orders, with the smaller types MATLAB stores doubles as, and a complex array
+    for (bool big: {false, true})
+    {
+        MatWriter w(big);
+        const auto path = root/(big ? "be.mat" : "le.mat");
+        write(path, w.header() + w.matrix<double>("data", table(), 6, 9) +
+            w.matrix<double>("c", {{1, 2}}, 6, 9, true) +
+            w.matrix<std::uint8_t>("u8", {{1, 2, 3}, {4, 5, 250}}, 6, 2) +
+            w.matrix<float>("sgl", {{1.5, -2.25}}, 7, 7) +
+            w.matrix<std::int16_t>("i16", {{-3}, {7}}, 10, 3));
+
+        const std::string what = big ? "big-endian" : "little-endian";
+        MatFile file(path.string());
+        check(file.names() == std::vector<std::string>({"data", "i16", "sgl", "u8"}), what + ": wrong arrays");
+        check_table(file, what);
+        check(file.at("data").is_view() == not big, what + ": the doubles are not viewed from the file");
+        check(file.at("u8").matrix()(1, 2) == 250, what + ": wrong uint8 array");
+        check(file.at("sgl").matrix()(0, 1) == -2.25, what + ": wrong single array");
+        check(file.at("i16").matrix()(0, 0) == -3, what + ": wrong int16 array");
+    }
+
+#ifdef TEST_ZLIB
+    {
+        MatWriter w(false);
+        write(root/"z.mat", w.header() + w.compressed(w.matrix<double>("data", table(), 6, 9)) +
+            w.matrix<double>("x", {{3}}, 6, 9));
+        MatFile file((root/"z.mat").string());
+        check_table(file, "compressed");
+        check(file.at("x").matrix()(0, 0) == 3, "compressed: wrong uncompressed array after it");
+    }
+#endif
+
+    // a malformed file is an error, not a crash
+    {
+        MatWriter w(false);
+        const auto s = w.header() + w.matrix<double>("data", table(), 6, 9);
+        write(root/"truncated.mat", s.substr(0, s.size() - 20));
+        bool thrown = false;
+        try
+        {
+            MatFile file((root/"truncated.mat").string());
+        }
+        catch (const std::runtime_error& e)
+        {
+            thrown = true;
+            std::cout << "truncated file: " << e.what() << "\n";
+        }
+        check(thrown, "a truncated file is read");
+    }
+
+    // a bus of tables and a constant, whose fields a BusSelector picks by name
+    {
+        MatWriter w(false);
+        std::vector<std::vector<double>> x, y;
+        for (int k = 0; k <= 4; k++)
+        {
+            x.push_back({0.25*k, 0.25*k});
+            y.push_back({0.25*k, 2.5*k, 5.0*k});
+        }
+        write(root/"kin.a.x.mat", w.header() + w.matrix<double>("data", x, 6, 9));
+        write(root/"kin.a.y.mat", w.header() + w.matrix<double>("data", y, 6, 9));
+        write(root/"kin.b.mat", w.header() + w.matrix<double>("data", {{0, 5}}, 6, 9));
+        write(root/"kin.txt", "not a MAT file");
+
+        auto bus = load_mat_files_as_bus(root.string(), "kin");
+        check(bus->fields().size() == 3, "bus: wrong fields");
+        Eigen::Index offset, size;
+        Value v;
+        bus->value(0.3, v);
+        check((v - Value((Value(4) << 0.3, 3, 6, 5).finished())).abs().maxCoeff() < 1e-12, "bus: wrong value");
+        check(bus->find("a", offset, size) and (offset == 0) and (size == 3), "bus: wrong nested bus");
+        check(bus->find("b", offset, size) and (offset == 3) and (size == 1), "bus: wrong field");
+
+        Submodel model("");
+        model.enter();
+        new BusSelector("S", "kin", {"a.y", "b"}, {"ay", "b"});
+        model.exit();
+        auto history = run(model,
+            [](uint k, double& t) -> bool
+            {
+                return arange(k, t, 0, 1, 0.25);
+            },
+            InputSources{{"kin", bus}}, NodeValues(), nullptr, Nodes(), 1, Observers());
+        const auto& ay = history.at("ay");
+        check((ay.rows() == 5) and (ay.cols() == 2) and (ay(4, 0) == 10) and (ay(4, 1) == 20), "bus: wrong selected field");
+        check(history.at("b")(2, 0) == 5, "bus: wrong selected constant");
+    }
+
+    std::filesystem::remove_all(root);
+    std::cout << (failed ? "FAILED" : "passed") << "\n";
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,42 @@
+#include <cmath>
+#include <iostream>
+
+#include "blocks.hpp"
+#include "helper.hpp"
+#include "solver.hpp"
+
+using namespace blocks;
+
+// x' = -m, with m the value of x held by a Memory at the last recorded point: every stage of a
+//   step sees the same m, so that x(k*dt) = (1 - dt)^k whatever the solver
+int main()
+{
+    Submodel model("");
+    model.enter();
+    new Memory("M", "x", "m", Value::Zero(1));
+    new Gain("G", -1.0, Nodes({"m"}), Nodes({"dx"}));
+    new Integrator("I", "dx", "x", Value::Ones(1));
+    model.exit();
+
+    const double dt = 0.1;
+    auto history = run(model,
+        [dt](uint k, double& t) -> bool
+        {
+            return arange(k, t, 0, 2, dt);
+        },
+        nullptr, NodeValues(), rk4, Nodes(), 1, Observers());
+
+    const auto& t = history.at("t");
+    const auto& x = history.at("x");
+    double error = 0;
+    for (Eigen::Index k = 0; k < x.rows(); k++)
+        error = std::max(error, std::abs(x(k, 0) - std::pow(1 - dt, k)));
+    std::cout << "x(" << t(1, 0) << ") = " << x(1, 0) << ", largest error: " << error << "\n";
+    if (error > 1e-12)
+    {
+        std::cout << "-- the Memory loop differs from (1 - dt)^k\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "model_file.hpp"
+
+using namespace blocks;
+
+static bool failed = false;
+
+static void check(bool ok, const std::string& what)
+{
+    if (not ok)
+    {
+        std::cout << "-- " << what << "\n";
+        failed = true;
+    }
+}
+
+static const char* model_file = R"(
+parameters
+    k = 2
+end
+
+define PT iports=u oports=y
+    Gain K k=3 iport=u oport=y
+end
+
+PT PT iports=x oports=y
+Gain K k=-1 iport=y oport=z
+)";
+
+static bool same(const BlockSpec& a, const BlockSpec& b)
+{
+    if ((a.type != b.type) or (a.name != b.name) or (a.args != b.args) or (a.components.size() != b.components.size()))
+        return false;
+    for (std::size_t k = 0; k < a.components.size(); k++)
+        if (not same(a.components[k], b.components[k]))
+            return false;
+    return true;
+}
+
+static bool same(const ModelSpec& a, const ModelSpec& b)
+{
+    return same(a.root, b.root) and (a.definitions.size() == 1) and (b.definitions.size() == 1) and
+        same(a.definitions[0], b.definitions[0]) and (a.parameters.first == b.parameters.first) and
+        (a.parameters.second[0][0] == b.parameters.second[0][0]);
+}
+
+// a model file compiled once is read back from its cache, which is written aside and then
+//   renamed. a damaged cache with a valid header, e.g. with a huge count, is parsed again.
+int main()
+{
+    const auto directory = std::filesystem::temp_directory_path()/"test_model_file";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    const auto path = (directory/"model.ssm").string(), cache_path = (directory/"model.ssmc").string();
+    std::ofstream(path) << model_file;
+
+    const auto parsed = load_model_spec(path);
+    check(same(load_model_spec(path, cache_path), parsed), "the compiled model differs");
+    check(same(load_model_spec(path, cache_path), parsed), "the cached model differs");
+    check(std::distance(std::filesystem::directory_iterator(directory), std::filesystem::directory_iterator()) == 2,
+        "files left besides the model and its cache");
+
+    // the header (magic, version and hash) is kept, the count of the root's type string follows
+    const auto size = std::filesystem::file_size(cache_path);
+    for (auto damage: {"huge count", "truncated"})
+    {
+        load_model_spec(path, cache_path);
+        if (damage == std::string("huge count"))
+        {
+            std::fstream cache(cache_path, std::ios::binary | std::ios::in | std::ios::out);
+            cache.seekp(16);
+            const std::uint64_t huge = ~std::uint64_t(0) >> 4;
+            cache.write(reinterpret_cast<const char*>(&huge), sizeof(huge));
+        }
+        else
+            std::filesystem::resize_file(cache_path, size/2);
+        check(same(load_model_spec(path, cache_path), parsed), std::string("wrong model from a cache with a ") + damage);
+    }
+    std::cout << "cache of " << size << " bytes read back, damaged ones parsed again\n";
+
+    std::filesystem::remove_all(directory);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,64 @@
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "observer.hpp"
+
+using namespace blocks;
+
+// sleeps on some points, and checks that they come in order with their values
+class SlowObserver : public Observer
+{
+public:
+    uint _n{0};
+    bool _ok{true};
+
+    void observe(uint k, double t, const RecordValues& values) override
+    {
+        if (k%100 == 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        _ok = _ok and (k == _n) and (t == 0.5*k) and (values.size() == 3) and (values[0] == k) and
+            (values[1] == -double(k)) and (values[2] == 2.0*k);
+        _n++;
+    }
+};
+
+// the points of a producer faster than its observer go through a ring of 4 slots and at most 2
+//   spill blocks of 4 slots, all in order
+int main()
+{
+    const uint n = 5000;
+    auto observer = std::make_shared<SlowObserver>();
+    std::size_t most_spilled = 0;
+    {
+        ObserverPipeline pipeline({observer}, {"x", "y"}, {1, 2}, 4, 2);
+        for (uint k = 0; k < n; k++)
+        {
+            double* values = pipeline.record(k, 0.5*k);
+            values[0] = k;
+            values[1] = -double(k);
+            values[2] = 2.0*k;
+            pipeline.commit();
+            most_spilled = std::max(most_spilled, pipeline.n_spilled());
+        }
+        pipeline.finish();
+    }
+
+    std::cout << observer->_n << " points observed, at most " << most_spilled << " spilled\n";
+    bool ok = true;
+    if ((observer->_n != n) or (not observer->_ok))
+    {
+        std::cout << "-- the points weren't all observed in order\n";
+        ok = false;
+    }
+    if ((most_spilled == 0) or (most_spilled > 8))
+    {
+        std::cout << "-- the spill isn't used, or not bounded\n";
+        ok = false;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,106 @@
+#include <cmath>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+#include "blocks.hpp"
+#include "helper.hpp"
+#include "solver.hpp"
+
+using namespace blocks;
+
+// the threads the functions ran on
+static std::mutex mutex;
+static std::set<std::thread::id> threads;
+
+// independent chains of n_functions functions of n_iterations iterations, each driving an
+//   integrator
+class Model : public Submodel
+{
+public:
+    Model(int n_chains, int n_functions, int n_iterations) : Submodel("")
+    {
+        enter();
+        {
+            for (int c = 0; c < n_chains; c++)
+            {
+                const auto s = std::to_string(c);
+                new Integrator(("I" + s).c_str(), "d" + s, "x" + s, Value::Constant(1, 0.1*(c + 1)));
+                Node previous = "x" + s;
+                for (int k = 0; k < n_functions; k++)
+                {
+                    Node next = "f" + s + "_" + std::to_string(k);
+                    new Function(("F" + s + "_" + std::to_string(k)).c_str(),
+                        [n_iterations](double t, const Value& x) -> Value
+                        {
+                            {
+                                std::lock_guard<std::mutex> lock(mutex);
+                                threads.insert(std::this_thread::get_id());
+                            }
+                            Value y = x;
+                            for (int i = 0; i < n_iterations; i++)
+                                y = (y.sin() + 0.999*x)/1.9;
+                            return y - 0.3*x + 0.01*std::cos(t);
+                        }, previous, next);
+                    previous = next;
+                }
+                new Gain(("G" + s).c_str(), -1.0, Nodes({previous}), Nodes({Node("d" + s)}));
+            }
+        }
+        exit();
+    }
+};
+
+static History simulate(int n_chains, int n_functions, int n_iterations, uint n_threads)
+{
+    threads.clear();
+    Model model(n_chains, n_functions, n_iterations);
+    return run(model,
+        [](uint k, double& t) -> bool
+        {
+            return arange(k, t, 0, 0.1, 0.01);
+        },
+        nullptr, NodeValues(), rk4, Nodes(), n_threads, Observers());
+}
+
+// the 4 chains of a heavy model are evaluated on several threads with the same results as on
+//   one, and the 2 of a light one stay on the caller's thread, where threads would cost more than
+//   they save
+int main()
+{
+    bool ok = true;
+    for (int n_iterations: {400, 1})
+    {
+        const bool heavy = (n_iterations > 1);
+        const auto sequential = simulate(heavy ? 4 : 2, heavy ? 10 : 1, n_iterations, 1);
+        for (uint n_threads: {2u, 4u})
+        {
+            const auto parallel = simulate(heavy ? 4 : 2, heavy ? 10 : 1, n_iterations, n_threads);
+            double difference = 0;
+            for (const auto& [node, values]: sequential)
+                difference = std::max(difference, (parallel.at(node) - values).cwiseAbs().maxCoeff());
+            std::cout << n_iterations << " iteration(s), " << n_threads << " threads: ran on " << threads.size()
+                      << ", largest difference from 1 thread: " << difference << "\n";
+
+            if (difference > 0)
+            {
+                std::cout << "-- the results differ from those of 1 thread\n";
+                ok = false;
+            }
+            if (heavy and (threads.size() < 2))
+            {
+                std::cout << "-- the heavy model isn't evaluated in parallel\n";
+                ok = false;
+            }
+            if ((not heavy) and (threads.size() != 1))
+            {
+                std::cout << "-- the light model is evaluated in parallel\n";
+                ok = false;
+            }
+        }
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# the model of py_ss/pendulum_with_pi.py run by py_ss and by the pyss bindings, whose histories
+#   should be the same. run with "make -f pyss.Makefile test".
+
+import os
+import sys
+
+import numpy as np
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '..', 'py_ss'))
+import blocks as py_blocks, helper as py_helper, solver as py_solver
+from pyss import blocks as cc_blocks, helper as cc_helper, solver as cc_solver
+
+# the classes of pendulum_with_pi.py, for either blocks module
+def make_model(blocks):
+    N = blocks.N
+
+    class Pendulum(blocks.Submodel):
+        def __init__(self, iport, oport):
+            super().__init__('pendulum', [iport], [oport])
+
+            # nodes
+            tau  = N(iport)
+            dphi = N('dphi')
+            phi  = N(oport)
+            m = N('m')
+            l = N('l')
+            g = N('g')
+
+            # blocks
+            with self:
+                blocks.MulDiv('tau/ml2', operations='*///', iports=[tau, m, l, l])
+                blocks.AddSub('err', operations='+-', iports=['-', -1])
+                blocks.Integrator('dphi', oport=dphi)
+                blocks.Integrator('phi', iport=dphi, oport=phi)
+                blocks.Function('sin(phi)', act_func=lambda t, x: np.sin(x), iport=phi)
+                blocks.MulDiv('g/l', operations='**/', iports=['-', g, l], oport=-1)
+
+    class PI(blocks.Submodel):
+        def __init__(self, Kp, Ki, iport, oport, x0=0.0):
+            super().__init__('PI', [iport], [oport])
+
+            # nodes
+            x = N(iport)
+
+            # blocks
+            with self:
+                blocks.Gain('Kp', k=Kp, iport=x, oport=-1)
+                blocks.Integrator('ix', iport=x, x0=x0)
+                blocks.Gain('Ki', k=Ki)
+                blocks.AddSub('', operations='++', iports=[-1, '-'], oport=N(oport))
+
+    class SSModel(blocks.Submodel):
+        def __init__(self):
+            super().__init__('')
+
+            # nodes
+            phi = N('phi')
+            tau = N('tau')
+            err = N('err')
+
+            # blocks
+            with self:
+                blocks.AddSub('',
+                              operations='+-',
+                              iports=[N('des_phi'), phi],
+                              oport=err)
+                PI(Kp=40.0, Ki=20.0, iport=err, oport=tau)
+                Pendulum(iport=tau, oport=phi)
+
+    return SSModel()
+
+def main():
+    parameters = {
+        'm': 0.2,
+        'l': 0.1,
+        'g': 9.81,
+        'des_phi': np.pi/4,
+        }
+    T = np.arange(0.0, 5.0, 0.01)
+
+    expected = py_helper.run(make_model(py_blocks), T=T, parameters=parameters, stepper=py_solver.rk4)
+    history = cc_helper.run(make_model(cc_blocks), T=list(T), parameters=parameters, stepper=cc_solver.rk4)
+
+    ok = True
+    for name in ['t', 'phi', 'dphi', 'tau', 'err']:
+        error = np.max(np.abs(np.asarray(history[name]) - np.asarray(expected[name])))
+        print('%s: largest difference from py_ss: %g' % (name, error))
+        if not (error < 1e-9):
+            print('-- %s differs from py_ss' % name)
+            ok = False
+
+    # the wrong input raises python exceptions
+    for f in [lambda: cc_blocks.Gain('K', k=1.0, iport=1.5),
+              lambda: cc_blocks.Integrator('I', x0='zero'),
+              lambda: cc_solver.symplectic(cc_blocks.Submodel('empty'), method='euler')]:
+        try:
+            f()
+            print('-- no exception for the wrong input')
+            ok = False
+        except (TypeError, ValueError) as e:
+            print('raised:', e)
+
+    sys.exit(0 if ok else 1)
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,86 @@
+#include <cmath>
+#include <iostream>
+#include <string>
+
+#include "blocks.hpp"
+#include "helper.hpp"
+#include "solver.hpp"
+
+using namespace blocks;
+
+// x' = u - a*x, delayed by d, then through a gain, a sine, a cube and a memory
+class Model : public Submodel
+{
+public:
+    Model() : Submodel("")
+    {
+        enter();
+        {
+            new MulDiv("ax", "**", {"a", "x"}, "ax");
+            new AddSub("xd", "+-", {"u", "ax"}, "xd");
+            new Integrator("I", "xd", "x");
+            new Delay("D", {"x", "d", "z"}, {"xdel"});
+            new Gain("K", 2.0, {"xdel"}, {"y"});
+            new Sin("s", {"y"}, {"sy"});
+            new Function("f", [](double /*t*/, const Value& v) -> Value {return v*v*v;}, "sy", "fy");
+            new Memory("M", "fy", "mem");
+        }
+        exit();
+    }
+};
+
+static History simulate(double a, double d, const Nodes& sensitivities=Nodes())
+{
+    Model model;
+    return run(model,
+        [](uint k, double& t) -> bool
+        {
+            return arange(k, t, 0, 3, 0.01);
+        },
+        nullptr, NodeValues({{"a", a}, {"d", d}, {"z", 0.0}, {"u", 1.0}}), rk4, sensitivities, 1, Observers());
+}
+
+// the sensitivities to a and d propagated through a run, against central differences of runs with
+//   perturbed parameters, and dx/da against the analytic (t*exp(-a*t)/a - (1 - exp(-a*t))/a^2).
+//   the delay is off the time grid, where the delayed values (interpolated linearly) have kinks
+//   that central differences don't see as derivatives do.
+int main()
+{
+    const double a = 0.7, d = 0.505, h = 1e-6;
+    const auto history = simulate(a, d, {"a", "d"});
+    const History perturbed[2][2] = {
+        {simulate(a + h, d), simulate(a - h, d)},
+        {simulate(a, d + h), simulate(a, d - h)}};
+
+    bool ok = true;
+    for (auto node: {"x", "xdel", "fy", "mem"})
+    {
+        uint n = 0;
+        for (auto parameter: {"a", "d"})
+        {
+            const auto& sensitivity = history.at(std::string("d(") + node + ")/d(" + parameter + ")");
+            const MatrixXd difference = (perturbed[n][0].at(node) - perturbed[n][1].at(node))/(2*h);
+            const double error = (sensitivity - difference).cwiseAbs().maxCoeff();
+            std::cout << "d(" << node << ")/d(" << parameter << "): largest difference from central differences: "
+                      << error << "\n";
+            if (error > 1e-5)
+            {
+                std::cout << "-- d(" << node << ")/d(" << parameter << ") differs from central differences\n";
+                ok = false;
+            }
+            n++;
+        }
+    }
+
+    const double t = 3;
+    const double dx_da = t*std::exp(-a*t)/a - (1 - std::exp(-a*t))/(a*a);
+    const double error = std::abs(history.at("d(x)/d(a)").bottomRows<1>()(0, 0) - dx_da);
+    std::cout << "d(x)/d(a) at t = 3: error: " << error << "\n";
+    if (error > 1e-8)
+    {
+        std::cout << "-- d(x)/d(a) differs from the analytic one\n";
+        ok = false;
+    }
+
+    return ok ? 0 : 1;
+}
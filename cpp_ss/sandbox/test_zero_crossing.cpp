@@ -0,0 +1,55 @@
+#include <cmath>
+#include <iostream>
+
+#include "blocks.hpp"
+#include "helper.hpp"
+#include "solver.hpp"
+
+using namespace blocks;
+
+// x' = 1 from x = 0, recorded every 0.1, with a switch at 0.55 given by a zero crossing. the switch
+//   is to be recorded exactly once, at its time and with the state there.
+static bool check(const char* name, ZCFunction zc_func)
+{
+    Submodel model("");
+    model.enter();
+    new Integrator("I", "one", "x", Value::Zero(1));
+    new Function("F", [](double /*t*/, const Value& x) -> Value {return x.min(0.55);}, "x", "y", zc_func);
+    model.exit();
+
+    auto history = run(model,
+        [](uint k, double& t) -> bool
+        {
+            return arange(k, t, 0, 1, 0.1);
+        },
+        nullptr, NodeValues({"one"}, {Value::Ones(1)}), rk4, Nodes(), 1, Observers());
+
+    const auto& t = history.at("t");
+    const auto& x = history.at("x");
+    uint n_events = 0;
+    double t_event = 0, error = 0;
+    for (Eigen::Index k = 0; k < t.rows(); k++)
+    {
+        if (std::abs(t(k, 0)/0.1 - std::round(t(k, 0)/0.1)) > 1e-9)
+        {
+            n_events++;
+            t_event = t(k, 0);
+        }
+        error = std::max(error, std::abs(x(k, 0) - t(k, 0)));
+    }
+    std::cout << name << ": " << n_events << " event(s), at " << t_event << ", largest state error: " << error << "\n";
+
+    if ((n_events != 1) or (std::abs(t_event - 0.55) > 1e-9) or (error > 1e-12))
+    {
+        std::cout << "-- " << name << ": the switch at 0.55 is not recorded once with its state\n";
+        return false;
+    }
+    return true;
+}
+
+int main()
+{
+    bool ok = check("state", [](double /*t*/, const Value& x) -> Scalars {return {x[0] - 0.55};});
+    ok = check("time", [](double t, const Value& /*x*/) -> Scalars {return {t - 0.55};}) and ok;
+    return ok ? 0 : 1;
+}
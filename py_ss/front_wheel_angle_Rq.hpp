@@ -1 +0,0 @@
-#ifndef __FRONT_WHEEL_ANGLE_RQ_HPP__
\ No newline at end of file
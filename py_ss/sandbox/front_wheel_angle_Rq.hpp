@@ -1,13 +0,0 @@
-
-#ifndef __FRONT_WHEEL_ANGLE_RQ_HPP__
-#define __FRONT_WHEEL_ANGLE_RQ_HPP__
-
-#include <vector>
-
-static constexpr auto FRONT_WHEEL_ANGLE_RQ_LEN = 100001;
-using FRONT_WHEEL_ANGLE_RQ_TYPE = std::vector<double>;
-
-extern const FRONT_WHEEL_ANGLE_RQ_TYPE FRONT_WHEEL_ANGLE_RQ_X;
-extern const FRONT_WHEEL_ANGLE_RQ_TYPE FRONT_WHEEL_ANGLE_RQ_Y;
-
-#endif // __FRONT_WHEEL_ANGLE_RQ_HPP__